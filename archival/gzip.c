@@ -70,6 +70,16 @@ aa:      85.1% -- replaced with aa.gz
 //config:	If this option is not selected, -N options are ignored and -9
 //config:	is used.
 //config:
+//config:config FEATURE_GZIP_PARALLEL
+//config:	bool "Enable parallel compression (-p N)"
+//config:	default y
+//config:	depends on GZIP && PLATFORM_POSIX && !NOMMU
+//config:	help
+//config:	Enable -p N option which compresses 128k blocks of input
+//config:	in N worker processes. Each block is primed with the last
+//config:	32k of the preceding one, and the result is a single gzip
+//config:	stream, only slightly bigger than a sequential one.
+//config:
 //config:config FEATURE_GZIP_DECOMPRESS
 //config:	bool "Enable decompression"
 //config:	default y
@@ -84,7 +94,7 @@ aa:      85.1% -- replaced with aa.gz
 //kbuild:lib-$(CONFIG_GZIP) += gzip.o
 
 //usage:#define gzip_trivial_usage
-//usage:       "[-cfk" IF_FEATURE_GZIP_DECOMPRESS("dt") IF_FEATURE_GZIP_LEVELS("123456789") "] [FILE]..."
+//usage:       "[-cfk" IF_FEATURE_GZIP_DECOMPRESS("dt") IF_FEATURE_GZIP_LEVELS("123456789") "]" IF_FEATURE_GZIP_PARALLEL(" [-p N]") " [FILE]..."
 //usage:#define gzip_full_usage "\n\n"
 //usage:       "Compress FILEs (or stdin)\n"
 //usage:	IF_FEATURE_GZIP_LEVELS(
@@ -97,6 +107,9 @@ aa:      85.1% -- replaced with aa.gz
 //usage:     "\n	-c	Write to stdout"
 //usage:     "\n	-f	Force"
 //usage:     "\n	-k	Keep input files"
+//usage:	IF_FEATURE_GZIP_PARALLEL(
+//usage:     "\n	-p N	Compress using N processes"
+//usage:	)
 //usage:
 //usage:#define gzip_example_usage
 //usage:       "$ ls -la /tmp/busybox*\n"
@@ -430,6 +443,14 @@ struct globals {
 
 	/*uint32_t *crc_32_tab;*/
 	uint32_t crc;	/* shift register contents */
+
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	unsigned nworkers;
+	/* Worker input is in memory, its crc is done by the parent */
+	const uch *src;
+	unsigned src_len;
+	smallint more_blocks;	/* worker's block is not the last one */
+#endif
 };
 
 #define G1 (*(ptr_to_globals - 1))
@@ -525,6 +546,15 @@ static unsigned file_read(void *buf, unsigned size)
 
 	Assert(G1.insize == 0, "l_buf not empty");
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	if (G1.src) {
+		len = MIN(size, G1.src_len);
+		memcpy(buf, G1.src, len);
+		G1.src += len;
+		G1.src_len -= len;
+		return len;
+	}
+#endif
 	len = safe_read(ifd, buf, size);
 	if (len == (unsigned)(-1) || len == 0)
 		return len;
@@ -1913,7 +1943,12 @@ static ulg deflate(void)
 	if (match_available)
 		ct_tally(0, G1.window[G1.strstart - 1]);
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	/* Only the last block of a parallel stream is final */
+	return FLUSH_BLOCK(!G1.more_blocks);
+#else
 	return FLUSH_BLOCK(1);	/* eof */
+#endif
 }
 
 
@@ -2101,6 +2136,143 @@ static void zip(void)
 	flush_outbuf();
 }
 
+#if ENABLE_FEATURE_GZIP_PARALLEL
+/* Uncompressed size of the blocks given to workers */
+#define PARALLEL_BLOCK (128 * 1024)
+
+/* ===========================================================================
+ * Deflate len bytes at buf, using dictlen bytes before it as the dictionary.
+ * Unless this is the last block, output ends with an empty stored block
+ * (a "sync flush") so that the next block starts on a byte boundary.
+ */
+static void deflate_block(const uch *buf, unsigned dictlen, unsigned len, int last)
+{
+	ush deflate_flags = 0;
+	IPos hash_head;
+	unsigned n;
+
+	G1.src = buf - dictlen;
+	G1.src_len = dictlen + len;
+	G1.more_blocks = !last;
+	lm_init(&deflate_flags);
+
+	/* Prime hash chains with the dictionary without emitting it */
+	for (n = 0; n < dictlen; n++)
+		INSERT_STRING(n, hash_head);
+	G1.strstart = dictlen;
+	G1.block_start = dictlen;
+	G1.lookahead -= dictlen;
+
+	deflate();
+	if (!last) {
+		send_bits(STORED_BLOCK << 1, 3);
+		copy_block(NULL, 0, 1);
+	}
+	flush_outbuf();
+}
+
+static uint32_t block_crc(const uch *buf, unsigned len)
+{
+	return ~crc32_block_endian0(~0, buf, len, global_crc32_table);
+}
+
+/* ===========================================================================
+ * Same as zip(), but blocks of input are deflated by G1.nworkers
+ * child processes. Output of each is piped back and written in order,
+ * crc of each block is computed by its worker too.
+ */
+static void zip_parallel(void)
+{
+	unsigned nblocks = G1.nworkers;
+	uch *buf = xmalloc(WSIZE + nblocks * PARALLEL_BLOCK);
+	pid_t *pids = xmalloc(nblocks * (sizeof(pids[0]) + sizeof(int)));
+	int *fds = (int*)(pids + nblocks);
+	unsigned dictlen = 0;
+	uint32_t crc = 0;
+	int last;
+
+	G1.outcnt = 0;
+	put_32bit(0x00088b1f);
+	put_32bit(0);		/* Unix timestamp */
+	put_8bit(2);		/* extra flags, see lm_init() */
+	put_8bit(3);		/* OS identifier = 3 (Unix) */
+	flush_outbuf();
+
+	bi_init();
+	ct_init();
+
+	do {
+		ssize_t rd;
+		unsigned total, njobs, i;
+
+		rd = full_read(ifd, buf + dictlen, nblocks * PARALLEL_BLOCK);
+		if (rd < 0)
+			bb_perror_msg_and_die(bb_msg_read_error);
+		total = rd;
+		G1.isize += total;
+		last = (total < nblocks * PARALLEL_BLOCK);
+
+		/* Input of exactly N*128k ends with an empty block */
+		njobs = total ? (total + PARALLEL_BLOCK - 1) / PARALLEL_BLOCK : 1;
+		for (i = 0; i < njobs; i++) {
+			unsigned ofs = i * PARALLEL_BLOCK;
+			unsigned len = MIN(PARALLEL_BLOCK, total - ofs);
+			int is_last = last && i == njobs - 1;
+			int pfd[2];
+
+			pids[i] = 0;
+			/* Only one block: do it ourself */
+			if (njobs == 1 && is_last) {
+				crc = crc32_combine(crc, block_crc(buf + dictlen, len), len);
+				deflate_block(buf + dictlen, MIN(WSIZE, dictlen), len, 1);
+				break;
+			}
+			xpipe(pfd);
+			pids[i] = xfork();
+			if (pids[i] == 0) {
+				/* child: send crc of the block, then its deflated data */
+				uint32_t c = block_crc(buf + dictlen + ofs, len);
+				close(pfd[0]);
+				xmove_fd(pfd[1], ofd);
+				xwrite(ofd, &c, sizeof(c));
+				deflate_block(buf + dictlen + ofs,
+					MIN(WSIZE, dictlen + ofs), len, is_last);
+				_exit(EXIT_SUCCESS);
+			}
+			close(pfd[1]);
+			fds[i] = pfd[0];
+		}
+		for (i = 0; i < njobs; i++) {
+			uint32_t c;
+
+			if (!pids[i])
+				continue;
+			xread(fds[i], &c, sizeof(c));
+			crc = crc32_combine(crc, c, MIN(PARALLEL_BLOCK, total - i * PARALLEL_BLOCK));
+			if (bb_copyfd_eof(fds[i], ofd) < 0)
+				xfunc_die();
+			close(fds[i]);
+			if (wait_for_exitstatus(pids[i]) != 0)
+				bb_error_msg_and_die("worker failed");
+		}
+
+		/* Keep the tail of input as the next dictionary */
+		total += dictlen;
+		dictlen = MIN(WSIZE, total);
+		memmove(buf, buf + total - dictlen, dictlen);
+	} while (!last);
+	G1.src = NULL;
+
+	/* Write the crc and uncompressed size */
+	put_32bit(crc);
+	put_32bit(G1.isize);
+	flush_outbuf();
+
+	free(pids);
+	free(buf);
+}
+#endif
+
 
 /* ======================================================================== */
 static
@@ -2152,7 +2324,12 @@ IF_DESKTOP(long long) int FAST_FUNC pack_gzip(transformer_state_t *xstate UNUSED
 	fstat(STDIN_FILENO, &s);
 	zip(s.st_ctime);
 #else
-	zip();
+# if ENABLE_FEATURE_GZIP_PARALLEL
+	if (G1.nworkers > 1)
+		zip_parallel();
+	else
+# endif
+		zip();
 #endif
 	return 0;
 }
@@ -2172,6 +2349,9 @@ static const char gzip_longopts[] ALIGN1 =
 	"fast\0"                No_argument       "1"
 	"best\0"                No_argument       "9"
 	"no-name\0"             No_argument       "n"
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	"processes\0"           Required_argument "p"
+#endif
 	;
 #endif
 
@@ -2197,6 +2377,7 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 #endif
 {
 	unsigned opt;
+	IF_FEATURE_GZIP_PARALLEL(const char *p_arg = NULL;)
 #if ENABLE_FEATURE_GZIP_LEVELS
 	static const struct {
 		uint8_t good;
@@ -2218,9 +2399,17 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 
 	/* Must match bbunzip's constants OPT_STDOUT, OPT_FORCE! */
 #if ENABLE_FEATURE_GZIP_LONG_OPTIONS
-	opt = getopt32long(argv, "cfkv" IF_FEATURE_GZIP_DECOMPRESS("dt") "qn123456789", gzip_longopts);
+	opt = getopt32long(argv, "cfkv" IF_FEATURE_GZIP_DECOMPRESS("dt") "qn123456789"
+			IF_FEATURE_GZIP_PARALLEL("p:"), gzip_longopts
+			IF_FEATURE_GZIP_PARALLEL(, &p_arg));
 #else
-	opt = getopt32(argv, "cfkv" IF_FEATURE_GZIP_DECOMPRESS("dt") "qn123456789");
+	opt = getopt32(argv, "cfkv" IF_FEATURE_GZIP_DECOMPRESS("dt") "qn123456789"
+			IF_FEATURE_GZIP_PARALLEL("p:")
+			IF_FEATURE_GZIP_PARALLEL(, &p_arg));
+#endif
+#if ENABLE_FEATURE_GZIP_PARALLEL
+	if (p_arg)
+		G1.nworkers = xatou_range(p_arg, 1, 1024);
 #endif
 #if ENABLE_FEATURE_GZIP_DECOMPRESS /* gunzip_main may not be visible... */
 	if (opt & 0x30) // -d and/or -t
@@ -2228,6 +2417,7 @@ int gzip_main(int argc UNUSED_PARAM, char **argv)
 #endif
 #if ENABLE_FEATURE_GZIP_LEVELS
 	opt >>= ENABLE_FEATURE_GZIP_DECOMPRESS ? 8 : 6; /* drop cfkv[dt]qn bits */
+	opt &= 0x1ff; /* drop -p */
 	if (opt == 0)
 		opt = 1 << 6; /* default: 6 */
 	opt = ffs(opt >> 4); /* Maps -1..-4 to [0], -5 to [1] ... -9 to [5] */
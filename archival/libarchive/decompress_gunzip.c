@@ -507,6 +507,120 @@ static void inflate_codes_setup(STATE_PARAM unsigned my_bl, unsigned my_bd)
 	ml = mask_bits[bl];		/* precompute masks for speed */
 	md = mask_bits[bd];
 }
+#if ENABLE_FEATURE_GUNZIP_FAST
+/* One length/distance pair takes at most 15+5+15+13 = 48 bits,
+ * and a match is at most 258 bytes */
+enum {
+	FAST_IN_SLACK = 8,
+	FAST_OUT_SLACK = 258,
+};
+/* Decode codes while there is enough input in bytebuffer and enough room
+ * in gunzip_window to not check either for every code.
+ * Bits are kept in a 64-bit buffer which is refilled once per code.
+ * Returns 1 on end of block, 0 when the slow path has to take over.
+ */
+static int inflate_codes_fast(STATE_PARAM_ONLY)
+{
+	unsigned char *win = gunzip_window;
+	unsigned char *in = bytebuffer + bytebuffer_offset;
+	unsigned char *in_end = bytebuffer + bytebuffer_size;
+	uint64_t bitbuf = bb;
+	unsigned bits = k;
+	unsigned pos = w;
+	unsigned e;
+	huft_t *t;
+	int eob = 0;
+
+	while ((unsigned)(in_end - in) >= FAST_IN_SLACK
+	 && pos <= GUNZIP_WSIZE - FAST_OUT_SLACK
+	) {
+		unsigned len, dist;
+
+		while (bits <= 56) {
+			bitbuf |= (uint64_t)*in++ << bits;
+			bits += 8;
+		}
+
+		t = tl + ((unsigned) bitbuf & ml);
+		e = t->e;
+		while (e > 16) {
+			if (e == 99)
+				abort_unzip(PASS_STATE_ONLY);
+			bitbuf >>= t->b;
+			bits -= t->b;
+			e -= 16;
+			t = t->v.t + ((unsigned) bitbuf & mask_bits[e]);
+			e = t->e;
+		}
+		bitbuf >>= t->b;
+		bits -= t->b;
+		if (e == 16) {	/* literal */
+			win[pos++] = (unsigned char) t->v.n;
+			continue;
+		}
+		if (e == 15) {	/* end of block */
+			eob = 1;
+			break;
+		}
+		len = t->v.n + ((unsigned) bitbuf & mask_bits[e]);
+		bitbuf >>= e;
+		bits -= e;
+
+		t = td + ((unsigned) bitbuf & md);
+		e = t->e;
+		while (e > 16) {
+			if (e == 99)
+				abort_unzip(PASS_STATE_ONLY);
+			bitbuf >>= t->b;
+			bits -= t->b;
+			e -= 16;
+			t = t->v.t + ((unsigned) bitbuf & mask_bits[e]);
+			e = t->e;
+		}
+		bitbuf >>= t->b;
+		bits -= t->b;
+		dist = t->v.n + ((unsigned) bitbuf & mask_bits[e]);
+		bitbuf >>= e;
+		bits -= e;
+
+		if (dist >= 8 && dist <= pos) {
+			/* Source does not wrap and is at least a word behind:
+			 * copy by words. Do not write past the end: bytes there
+			 * are still history a later match can refer to */
+			unsigned char *dst = win + pos;
+			unsigned char *src = dst - dist;
+			pos += len;
+			while (len >= 8) {
+				memcpy(dst, src, 8); /* compiles to load+store */
+				dst += 8;
+				src += 8;
+				len -= 8;
+			}
+			while (len) {
+				*dst++ = *src++;
+				len--;
+			}
+		} else {
+			unsigned from = pos - dist;
+			do {
+				win[pos++] = win[from++ & (GUNZIP_WSIZE - 1)];
+			} while (--len);
+		}
+	}
+
+	/* Give back whole bytes we have read ahead (but not those which
+	 * the slow path had already put into bb) */
+	while (bits >= 8 && in > bytebuffer + bytebuffer_offset) {
+		in--;
+		bits -= 8;
+	}
+	bytebuffer_offset = in - bytebuffer;
+	bb = bitbuf & (((uint64_t)1 << bits) - 1);
+	k = bits;
+	w = pos;
+	return eob;
+}
+#endif
 /* called once from inflate_get_next_window */
 static NOINLINE int inflate_codes(STATE_PARAM_ONLY)
 {
@@ -517,6 +631,10 @@ static NOINLINE int inflate_codes(STATE_PARAM_ONLY)
 		goto do_copy;
 
 	while (1) {			/* do until end of block */
+#if ENABLE_FEATURE_GUNZIP_FAST
+		if (inflate_codes_fast(PASS_STATE_ONLY))
+			break;
+#endif
 		bb = fill_bitbuffer(PASS_STATE bb, &k, bl);
 		t = tl + ((unsigned) bb & ml);
 		e = t->e;
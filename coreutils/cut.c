@@ -66,27 +66,33 @@ static int cmpfunc(const void *a, const void *b)
 			((struct cut_list *) b)->startpos);
 }
 
-static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, unsigned nlists)
+static void cut_file(int fd, char delim, const struct cut_list *cut_lists, unsigned nlists)
 {
+	line_reader_t *lr = line_reader_fdopen(fd);
 	char *line;
+	char *printed = NULL;
+	size_t linelen, printed_size = 0;
 	unsigned linenum = 0;	/* keep these zero-based to be consistent */
 
 	/* go through every line in the file */
-	while ((line = xmalloc_fgetline(file)) != NULL) {
-
-		/* set up a list so we can keep track of what's been printed */
-		int linelen = strlen(line);
-		char *printed = xzalloc(linelen + 1);
-		char *orig_line = line;
+	while ((line = line_reader_next_str(lr, '\n', &linelen)) != NULL) {
 		unsigned cl_pos = 0;
 		int spos;
 
+		/* set up a list so we can keep track of what's been printed */
+		if (printed_size <= linelen) {
+			printed_size = linelen + 1;
+			free(printed);
+			printed = xmalloc(printed_size);
+		}
+		memset(printed, 0, linelen + 1);
+
 		/* cut based on chars/bytes XXX: only works when sizeof(char) == byte */
 		if (option_mask32 & (CUT_OPT_CHAR_FLGS | CUT_OPT_BYTE_FLGS)) {
 			/* print the chars specified in each cut list */
 			for (; cl_pos < nlists; cl_pos++) {
 				spos = cut_lists[cl_pos].startpos;
-				while (spos < linelen) {
+				while (spos < (int)linelen) {
 					if (!printed[spos]) {
 						printed[spos] = 'X';
 						putchar(line[spos]);
@@ -186,9 +192,9 @@ static void cut_file(FILE *file, char delim, const struct cut_list *cut_lists, u
 		putchar('\n');
  next_line:
 		linenum++;
-		free(printed);
-		free(orig_line);
 	}
+	free(printed);
+	line_reader_free(lr);
 }
 
 int cut_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
@@ -303,13 +309,14 @@ int cut_main(int argc UNUSED_PARAM, char **argv)
 			*--argv = (char *)"-";
 
 		do {
-			FILE *file = fopen_or_warn_stdin(*argv);
-			if (!file) {
+			int fd = open_or_warn_stdin(*argv);
+			if (fd < 0) {
 				retval = EXIT_FAILURE;
 				continue;
 			}
-			cut_file(file, delim, cut_lists, nlists);
-			fclose_if_not_stdin(file);
+			cut_file(fd, delim, cut_lists, nlists);
+			if (fd != STDIN_FILENO)
+				close(fd);
 		} while (*++argv);
 
 		if (ENABLE_FEATURE_CLEAN_UP)
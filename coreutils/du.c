@@ -31,6 +31,18 @@
 //config:	depends on DU
 //config:	help
 //config:	Use a blocksize of (1K) instead of the default 512b.
+//config:
+//config:config FEATURE_DU_PARALLEL
+//config:	bool "Enable parallel traversal (-j N)"
+//config:	default y
+//config:	depends on DU && PLATFORM_POSIX && !NOMMU
+//config:	select FEATURE_PROC_POOL
+//config:	help
+//config:	Enable -j N option: subdirectories of each FILE are sized
+//config:	by N worker processes. Output order is not changed.
+//config:	Used only with -l and without -H and -L: workers would not
+//config:	see which files and directories the others have already
+//config:	counted.
 
 //applet:IF_DU(APPLET(du, BB_DIR_USR_BIN, BB_SUID_DROP))
 
@@ -40,7 +52,7 @@
 /* http://www.opengroup.org/onlinepubs/007904975/utilities/du.html */
 
 //usage:#define du_trivial_usage
-//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k] [FILE]..."
+//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k]" IF_FEATURE_DU_PARALLEL(" [-j N]") " [FILE]..."
 //usage:#define du_full_usage "\n\n"
 //usage:       "Summarize disk space used for each FILE and/or directory\n"
 //usage:     "\n	-a	Show file sizes too"
@@ -51,6 +63,10 @@
 //usage:     "\n	-l	Count sizes many times if hard linked"
 //usage:     "\n	-s	Display only a total for each argument"
 //usage:     "\n	-x	Skip directories on different filesystems"
+//usage:	IF_FEATURE_DU_PARALLEL(
+//usage:     "\n	-j N	Size subdirectories using N processes (only with -l,"
+//usage:     "\n		not with -H/-L)"
+//usage:	)
 //usage:	IF_FEATURE_HUMAN_READABLE(
 //usage:     "\n	-h	Sizes in human readable format (e.g., 1K 243M 2G)"
 //usage:     "\n	-m	Sizes in megabytes"
@@ -101,6 +117,9 @@ struct globals {
 	int slink_depth;
 	int du_depth;
 	dev_t dir_dev;
+#if ENABLE_FEATURE_DU_PARALLEL
+	proc_pool_t *pool;   /* -j N: top level entries are sized by workers */
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { setup_common_bufsiz(); } while (0)
@@ -137,6 +156,23 @@ static void print(unsigned long long size, const char *filename)
 #endif
 }
 
+static unsigned long long du(const char *filename);
+
+#if ENABLE_FEATURE_DU_PARALLEL
+/* Sizes an entry of the directory in a worker of G.pool.
+ * Worker passes its sum back through the pool,
+ * which also keeps the output in order */
+static int FAST_FUNC du_pool_entry(const char *name, unsigned d_type UNUSED_PARAM,
+		unsigned long long *result, void *dirname)
+{
+	char *newfile = concat_path_file(dirname, name);
+
+	*result += du(newfile);
+	free(newfile);
+	return !G.status;
+}
+#endif
+
 /* tiny recursive du */
 static unsigned long long du(const char *filename)
 {
@@ -195,6 +231,20 @@ static unsigned long long du(const char *filename)
 			return sum;
 		}
 
+#if ENABLE_FEATURE_DU_PARALLEL
+		if (G.pool && G.du_depth == 0) {
+			/* Workers see entries at depth 1. No -H/-L with pool,
+			 * symlinks are never followed */
+			G.du_depth = 1;
+			if (!proc_pool_walk_dir(G.pool, dir, /*follow_links:*/ 0,
+					du_pool_entry, NULL, (char*)filename)
+			) {
+				G.status = EXIT_FAILURE;
+			}
+			G.du_depth = 0;
+			sum += G.pool->total;
+		} else
+#endif
 		while ((entry = readdir(dir))) {
 			newfile = concat_subpath_file(filename, entry->d_name);
 			if (newfile == NULL)
@@ -221,6 +271,7 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	unsigned long long total;
 	int slink_depth_save;
 	unsigned opt;
+	IF_FEATURE_DU_PARALLEL(unsigned nworkers = 0;)
 
 	INIT_G();
 
@@ -243,9 +294,10 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	 */
 #if ENABLE_FEATURE_HUMAN_READABLE
 	opt = getopt32(argv, "^"
-			"aHkLsxd:+lchm"
+			"aHkLsxd:+lchm" IF_FEATURE_DU_PARALLEL("j:+")
 			"\0" "h-km:k-hm:m-hk:H-L:L-H:s-d:d-s",
 			&G.max_print_depth
+			IF_FEATURE_DU_PARALLEL(, &nworkers)
 	);
 	argv += optind;
 	if (opt & OPT_h_for_humans) {
@@ -259,9 +311,10 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	}
 #else
 	opt = getopt32(argv, "^"
-			"aHkLsxd:+lc"
+			"aHkLsxd:+lc" IF_FEATURE_DU_PARALLEL("j:+")
 			"\0" "H-L:L-H:s-d:d-s",
 			&G.max_print_depth
+			IF_FEATURE_DU_PARALLEL(, &nworkers)
 	);
 	argv += optind;
 #if !ENABLE_FEATURE_DU_DEFAULT_BLOCKSIZE_1K
@@ -279,6 +332,13 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	if (opt & OPT_s_total_norecurse) {
 		G.max_print_depth = 0;
 	}
+#if ENABLE_FEATURE_DU_PARALLEL
+	/* A hard linked file, or with symlinks followed a directory,
+	 * can be reached through two subdirectories. Only one du process
+	 * can count it once */
+	if (nworkers > 1 && (opt & OPT_l_hardlinks) && !G.slink_depth)
+		G.pool = proc_pool_new(nworkers);
+#endif
 
 	/* go through remaining args (if any) */
 	if (!*argv) {
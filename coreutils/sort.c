@@ -28,6 +28,25 @@
 //config:
 //config:	The SuSv3 sort standard is available at:
 //config:	http://www.opengroup.org/onlinepubs/007904975/utilities/sort.html
+//config:
+//config:config FEATURE_SORT_MERGE
+//config:	bool "Support -m, -S and -T (merge, sort files larger than memory)"
+//config:	default y
+//config:	depends on FEATURE_SORT_BIG
+//config:	help
+//config:	With -S SIZE, sort keeps at most about SIZE bytes of input
+//config:	in memory: sorted runs are spilled to temporary files in
+//config:	-T DIR (else $TMPDIR, else /tmp) and merged at the end.
+//config:	-m merges already sorted inputs without sorting them.
+//config:
+//config:config FEATURE_SORT_PARALLEL
+//config:	bool "Support --parallel=N (sort using N processes)"
+//config:	default y
+//config:	depends on FEATURE_SORT_BIG && LONG_OPTS && PLATFORM_POSIX && !NOMMU
+//config:	help
+//config:	Split lines between N forked workers, sort the parts
+//config:	concurrently and merge them. Output is the same as
+//config:	without --parallel.
 
 //applet:IF_SORT(APPLET_NOEXEC(sort, sort, BB_DIR_USR_BIN, BB_SUID_DROP, sort))
 
@@ -62,9 +81,14 @@
 //usage:     "\n	-u	Suppress duplicate lines"
 //usage:	IF_FEATURE_SORT_BIG(
 //usage:     "\n	-z	Lines are terminated by NUL, not newline"
-////usage:     "\n	-m	Ignored for GNU compatibility"
-////usage:     "\n	-S BUFSZ Ignored for GNU compatibility"
-////usage:     "\n	-T TMPDIR Ignored for GNU compatibility"
+//usage:	)
+//usage:	IF_FEATURE_SORT_MERGE(
+//usage:     "\n	-m	Merge already sorted files"
+//usage:     "\n	-S SIZE	Use temp files if input exceeds SIZE[b|K|M|G] bytes"
+//usage:     "\n	-T DIR	Directory for temp files"
+//usage:	)
+//usage:	IF_FEATURE_SORT_PARALLEL(
+//usage:     "\n	--parallel=N	Sort using N processes"
 //usage:	)
 //usage:
 //usage:#define sort_example_usage
@@ -94,7 +118,7 @@
 */
 
 /* These are sort types */
-#define OPT_STR "ngMucszbrdfimS:T:o:k:*t:"
+#define OPT_STR "ngMucszbrdfimS:T:o:k:*t:" IF_FEATURE_SORT_PARALLEL("\xff:")
 enum {
 	FLAG_n  = 1,            /* Numeric sort */
 	FLAG_g  = 2,            /* Sort using strtod() */
@@ -110,12 +134,13 @@ enum {
 	FLAG_d  = 0x200,        /* Ignore !(isalnum()|isspace()) */
 	FLAG_f  = 0x400,        /* Force uppercase */
 	FLAG_i  = 0x800,        /* Ignore !isprint() */
-	FLAG_m  = 0x1000,       /* ignored: merge already sorted files; do not sort */
-	FLAG_S  = 0x2000,       /* ignored: -S, --buffer-size=SIZE */
-	FLAG_T  = 0x4000,       /* ignored: -T, --temporary-directory=DIR */
+	FLAG_m  = 0x1000,       /* Merge already sorted files; do not sort */
+	FLAG_S  = 0x2000,       /* -S, --buffer-size=SIZE */
+	FLAG_T  = 0x4000,       /* -T, --temporary-directory=DIR */
 	FLAG_o  = 0x8000,
 	FLAG_k  = 0x10000,
 	FLAG_t  = 0x20000,
+	FLAG_parallel = 0x40000, /* --parallel=N */
 	FLAG_bb = 0x80000000,   /* Ignore trailing blanks  */
 };
 
@@ -127,6 +152,7 @@ static struct sort_key {
 	unsigned range[4];          /* start word, start char, end word, end char */
 	unsigned flags;
 } *key_list;
+static unsigned key_count;
 
 static char *get_key(char *str, struct sort_key *key, int flags)
 {
@@ -229,112 +255,169 @@ static char *get_key(char *str, struct sort_key *key, int flags)
 static struct sort_key *add_key(void)
 {
 	struct sort_key **pkey = &key_list;
+	key_count++;
 	while (*pkey)
 		pkey = &((*pkey)->next_key);
 	return *pkey = xzalloc(sizeof(struct sort_key));
 }
 
-#define GET_LINE(fp) \
-	((option_mask32 & FLAG_z) \
-	? bb_get_chunk_from_file(fp, NULL) \
-	: xmalloc_fgetline(fp))
+#define LINE_DELIM ((option_mask32 & FLAG_z) ? '\0' : '\n')
 #else
-#define GET_LINE(fp) xmalloc_fgetline(fp)
+#define LINE_DELIM '\n'
+#endif
+
+struct sort_line {
+	char *str;
+#if ENABLE_FEATURE_SORT_BIG
+	struct key_val *key;    /* key_count cached keys */
+#endif
+};
+
+#if ENABLE_FEATURE_SORT_BIG
+/* Keys are extracted and parsed once per line, not on every comparison */
+struct key_val {
+	union {
+		char *str;      /* get_key() result */
+		double num;     /* -n, -g */
+		int month;      /* -M */
+	} u;
+	int class;              /* -g: not number < NaN < numbers; -M: valid month */
+};
+
+static void extract_keys(struct sort_line *line, struct key_val *kv)
+{
+	struct sort_key *key;
+
+	line->key = kv;
+	for (key = key_list; key; key = key->next_key, kv++) {
+		int flags = key->flags ? key->flags : option_mask32;
+		/* Chop out and modify key chunks, handling -dfib */
+		char *x = get_key(line->str, key, flags);
+
+		kv->class = 0;
+		switch (flags & (FLAG_n | FLAG_M | FLAG_g)) {
+		default:
+			bb_error_msg_and_die("unknown sort type");
+			break;
+		/* Ascii sort */
+		case 0:
+			kv->u.str = x;
+			continue; /* keep the copy */
+		case FLAG_g: {
+			char *xx;
+			kv->u.num = strtod(x, &xx);
+			if (x != xx)
+				/* Check for isnan */
+				kv->class = (kv->u.num != kv->u.num) ? 1 : 2;
+			break;
+		}
+		case FLAG_M: {
+			struct tm thyme;
+			if (strptime(x, "%b", &thyme)) {
+				kv->u.month = thyme.tm_mon;
+				kv->class = 1;
+			}
+			break;
+		}
+		/* Full floating point version of -n */
+		case FLAG_n:
+			kv->u.num = atof(x);
+			break;
+		} /* switch */
+		if (x != line->str)
+			free(x);
+	}
+}
+
+/* Free key copies */
+static void free_keys(struct sort_line *line)
+{
+	struct sort_key *key;
+	struct key_val *kv = line->key;
+
+	for (key = key_list; key; key = key->next_key, kv++) {
+		int flags = key->flags ? key->flags : option_mask32;
+		if (!(flags & (FLAG_n | FLAG_M | FLAG_g)) && kv->u.str != line->str)
+			free(kv->u.str);
+	}
+}
+
+static struct key_val *extract_all_keys(struct sort_line *lines, int linecount)
+{
+	struct key_val *kv = xmalloc(linecount * key_count * sizeof(kv[0]));
+	int i;
+
+	for (i = 0; i < linecount; i++)
+		extract_keys(&lines[i], kv + i * key_count);
+	return kv;
+}
+
+static void free_all_keys(struct sort_line *lines, int linecount, struct key_val *kv)
+{
+	int i;
+
+	for (i = 0; i < linecount; i++)
+		free_keys(&lines[i]);
+	free(kv);
+}
 #endif
 
 /* Iterate through keys list and perform comparisons */
 static int compare_keys(const void *xarg, const void *yarg)
 {
+	const struct sort_line *x = xarg;
+	const struct sort_line *y = yarg;
 	int flags = option_mask32, retval = 0;
-	char *x, *y;
 
 #if ENABLE_FEATURE_SORT_BIG
 	struct sort_key *key;
+	struct key_val *kx = x->key;
+	struct key_val *ky = y->key;
 
-	for (key = key_list; !retval && key; key = key->next_key) {
+	for (key = key_list; !retval && key; key = key->next_key, kx++, ky++) {
 		flags = key->flags ? key->flags : option_mask32;
-		/* Chop out and modify key chunks, handling -dfib */
-		x = get_key(*(char **)xarg, key, flags);
-		y = get_key(*(char **)yarg, key, flags);
 #else
 	/* This curly bracket serves no purpose but to match the nesting
 	 * level of the for () loop we're not using */
 	{
-		x = *(char **)xarg;
-		y = *(char **)yarg;
 #endif
 		/* Perform actual comparison */
 		switch (flags & (FLAG_n | FLAG_M | FLAG_g)) {
-		default:
-			bb_error_msg_and_die("unknown sort type");
-			break;
 		/* Ascii sort */
 		case 0:
-#if ENABLE_LOCALE_SUPPORT
-			retval = strcoll(x, y);
-#else
-			retval = strcmp(x, y);
-#endif
-			break;
 #if ENABLE_FEATURE_SORT_BIG
-		case FLAG_g: {
-			char *xx, *yy;
-			double dx = strtod(x, &xx);
-			double dy = strtod(y, &yy);
-			/* not numbers < NaN < -infinity < numbers < +infinity) */
-			if (x == xx)
-				retval = (y == yy ? 0 : -1);
-			else if (y == yy)
-				retval = 1;
-			/* Check for isnan */
-			else if (dx != dx)
-				retval = (dy != dy) ? 0 : -1;
-			else if (dy != dy)
-				retval = 1;
-			/* Check for infinity.  Could underflow, but it avoids libm. */
-			else if (1.0 / dx == 0.0) {
-				if (dx < 0)
-					retval = (1.0 / dy == 0.0 && dy < 0) ? 0 : -1;
-				else
-					retval = (1.0 / dy == 0.0 && dy > 0) ? 0 : 1;
-			} else if (1.0 / dy == 0.0)
-				retval = (dy < 0) ? 1 : -1;
-			else
-				retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+# if ENABLE_LOCALE_SUPPORT
+			retval = strcoll(kx->u.str, ky->u.str);
+# else
+			retval = strcmp(kx->u.str, ky->u.str);
+# endif
 			break;
-		}
-		case FLAG_M: {
-			struct tm thyme;
-			int dx;
-			char *xx, *yy;
-
-			xx = strptime(x, "%b", &thyme);
-			dx = thyme.tm_mon;
-			yy = strptime(y, "%b", &thyme);
-			if (!xx)
-				retval = (!yy) ? 0 : -1;
-			else if (!yy)
-				retval = 1;
-			else
-				retval = dx - thyme.tm_mon;
+		case FLAG_g:
+			/* not numbers < NaN < -infinity < numbers < +infinity) */
+			retval = kx->class - ky->class;
+			if (retval || kx->class != 2)
+				break;
+			/* fall through */
+		case FLAG_n:
+			retval = (kx->u.num > ky->u.num) - (kx->u.num < ky->u.num);
 			break;
-		}
-		/* Full floating point version of -n */
-		case FLAG_n: {
-			double dx = atof(x);
-			double dy = atof(y);
-			retval = (dx > dy) ? 1 : ((dx < dy) ? -1 : 0);
+		case FLAG_M:
+			retval = kx->class - ky->class;
+			if (!retval && kx->class)
+				retval = kx->u.month - ky->u.month;
 			break;
-		}
 		} /* switch */
-		/* Free key copies. */
-		if (x != *(char **)xarg) free(x);
-		if (y != *(char **)yarg) free(y);
 		/* if (retval) break; - done by for () anyway */
 #else
+# if ENABLE_LOCALE_SUPPORT
+			retval = strcoll(x->str, y->str);
+# else
+			retval = strcmp(x->str, y->str);
+# endif
+			break;
 		/* Integer version of -n for tiny systems */
 		case FLAG_n:
-			retval = atoi(x) - atoi(y);
+			retval = atoi(x->str) - atoi(y->str);
 			break;
 		} /* switch */
 #endif
@@ -343,7 +426,7 @@ static int compare_keys(const void *xarg, const void *yarg)
 	/* Perform fallback sort if necessary */
 	if (!retval && !(option_mask32 & FLAG_s)) {
 		flags = option_mask32;
-		retval = strcmp(*(char **)xarg, *(char **)yarg);
+		retval = strcmp(x->str, y->str);
 	}
 
 	if (flags & FLAG_r)
@@ -352,6 +435,357 @@ static int compare_keys(const void *xarg, const void *yarg)
 	return retval;
 }
 
+/* -u drops lines for which only the key is the same */
+static int compare_unique(const void *xarg, const void *yarg)
+{
+	unsigned opts = option_mask32;
+	int retval;
+
+	/* coreutils 6.3 drop lines for which only key is the same */
+	/* -- disabling last-resort compare... */
+	option_mask32 |= FLAG_s;
+	retval = compare_keys(xarg, yarg);
+	option_mask32 = opts;
+	return retval;
+}
+
+#if ENABLE_FEATURE_SORT_PARALLEL
+/* Don't bother forking for less than this many lines per worker */
+#define PARALLEL_MIN_LINES 4096
+
+static unsigned nworkers;
+
+/* Stable merge of src[lo..mid) and src[mid..hi) into dst[lo..hi) */
+static void merge_slices(struct sort_line *src, struct sort_line *dst,
+		unsigned lo, unsigned mid, unsigned hi)
+{
+	unsigned i = lo, j = mid;
+
+	while (i < mid && j < hi) {
+		/* Ties go to the left slice, which came first in input */
+		if (compare_keys(&src[j], &src[i]) < 0)
+			dst[lo++] = src[j++];
+		else
+			dst[lo++] = src[i++];
+	}
+	memcpy(&dst[lo], &src[i], (mid - i) * sizeof(src[0]));
+	memcpy(&dst[lo + mid - i], &src[j], (hi - j) * sizeof(src[0]));
+}
+
+/* Sort (if !dst) or pairwise merge (into dst) the slices of src
+ * delimited by bound[0..nslices]. Jobs run in forked children
+ * which send the resulting array back through a pipe: the child
+ * is a copy of us, the pointers in it are valid here too.
+ */
+static void fork_pass(struct sort_line *src, struct sort_line *dst,
+		unsigned *bound, unsigned nslices)
+{
+	unsigned njobs = dst ? (nslices + 1) / 2 : nslices;
+	pid_t *pids = xmalloc(njobs * (sizeof(pids[0]) + sizeof(int)));
+	int *fds = (int*)(pids + njobs);
+	unsigned i;
+
+	for (i = 0; i < njobs; i++) {
+		unsigned lo, mid, hi;
+		struct sort_line *res;
+		int pfd[2];
+
+		if (dst) {
+			lo = bound[2*i];
+			mid = bound[MIN(2*i + 1, nslices)];
+			hi = bound[MIN(2*i + 2, nslices)];
+			res = dst;
+		} else {
+			lo = mid = bound[i];
+			hi = bound[i + 1];
+			res = src;
+		}
+		pids[i] = 0;
+		/* Last pass, or nothing to merge with: do it ourself */
+		if (njobs == 1 || mid == hi) {
+			if (dst)
+				merge_slices(src, dst, lo, mid, hi);
+			else
+				qsort(&src[lo], hi - lo, sizeof(src[0]), compare_keys);
+			continue;
+		}
+		xpipe(pfd);
+		pids[i] = xfork();
+		if (pids[i] == 0) {
+			/* child */
+			close(pfd[0]);
+			if (dst)
+				merge_slices(src, dst, lo, mid, hi);
+			else
+				qsort(&src[lo], hi - lo, sizeof(src[0]), compare_keys);
+			xwrite(pfd[1], &res[lo], (hi - lo) * sizeof(res[0]));
+			_exit(EXIT_SUCCESS);
+		}
+		close(pfd[1]);
+		fds[i] = pfd[0];
+	}
+	for (i = 0; i < njobs; i++) {
+		unsigned lo, hi;
+
+		if (!pids[i])
+			continue;
+		lo = bound[dst ? 2*i : i];
+		hi = bound[dst ? MIN(2*i + 2, nslices) : i + 1];
+		xread(fds[i], &(dst ? dst : src)[lo], (hi - lo) * sizeof(src[0]));
+		close(fds[i]);
+		if (wait_for_exitstatus(pids[i]) != 0)
+			bb_error_msg_and_die("worker failed");
+	}
+	free(pids);
+}
+
+static void sort_lines(struct sort_line *lines, unsigned linecount)
+{
+	unsigned *bound;
+	struct sort_line *src, *dst;
+	unsigned n, i;
+
+	n = MIN(nworkers, linecount / PARALLEL_MIN_LINES);
+	if (n < 2) {
+		qsort(lines, linecount, sizeof(lines[0]), compare_keys);
+		return;
+	}
+
+	bound = xmalloc((n + 1) * sizeof(bound[0]));
+	for (i = 0; i <= n; i++)
+		bound[i] = (unsigned long long)linecount * i / n;
+	fork_pass(lines, NULL, bound, n);
+
+	src = lines;
+	dst = xmalloc(linecount * sizeof(lines[0]));
+	while (n > 1) {
+		struct sort_line *t;
+
+		fork_pass(src, dst, bound, n);
+		for (i = 0; 2*i < n; i++)
+			bound[i] = bound[2*i];
+		bound[i] = linecount;
+		n = i;
+		t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != lines) {
+		memcpy(lines, src, linecount * sizeof(lines[0]));
+		dst = src;
+	}
+	free(dst);
+	free(bound);
+}
+#else
+# define sort_lines(lines, linecount) \
+	qsort(lines, linecount, sizeof(lines[0]), compare_keys)
+#endif
+
+/* Sort lines and write them to fp, handling -u */
+static void sort_and_write(FILE *fp, struct sort_line *lines, int linecount)
+{
+	int ch = (option_mask32 & FLAG_z) ? '\0' : '\n';
+	int i, j;
+#if ENABLE_FEATURE_SORT_BIG
+	struct key_val *kv = extract_all_keys(lines, linecount);
+#endif
+
+	sort_lines(lines, linecount);
+
+	for (i = j = 0; i < linecount; i++) {
+		if (i && (option_mask32 & FLAG_u)
+		 && compare_unique(&lines[j], &lines[i]) == 0
+		) {
+			continue;
+		}
+		j = i;
+		fprintf(fp, "%s%c", lines[i].str, ch);
+	}
+#if ENABLE_FEATURE_SORT_BIG
+	free_all_keys(lines, linecount, kv);
+#endif
+}
+
+#if ENABLE_FEATURE_SORT_MERGE
+/* No more than this many files are merged at once */
+#define MERGE_FANIN 16
+
+struct merge_src {
+	line_reader_t *lr;
+	struct sort_line line;
+};
+
+static const struct suffix_mult sort_S_suffixes[] = {
+	{ "b", 1 },
+	{ "k", 1024 },
+	{ "K", 1024 },
+	{ "M", 1024*1024 },
+	{ "G", 1024*1024*1024 },
+	{ "", 0 }
+};
+
+static const char *tmp_dir;
+/* Sorted runs spilled to temp files */
+static FILE **run_files;
+static unsigned run_count;
+/* -S: spill a run when lines in memory take more than this */
+static unsigned long mem_limit;
+static unsigned long mem_used;
+
+static FILE *xtmpfile(void)
+{
+	char *name;
+	FILE *fp;
+	int fd;
+
+	name = concat_path_file(tmp_dir, "sortXXXXXX");
+	fd = xmkstemp(name);
+	/* Unlinked right away: nothing to clean up if we die */
+	unlink(name);
+	free(name);
+	fp = fdopen(fd, "w+");
+	if (!fp)
+		bb_perror_nomsg_and_die();
+	return fp;
+}
+
+static void xflush_and_rewind(FILE *fp)
+{
+	if (fflush(fp) != 0 || ferror(fp))
+		bb_perror_msg_and_die(bb_msg_write_error);
+	rewind(fp);
+}
+
+static int read_line(line_reader_t *lr, struct sort_line *line)
+{
+	size_t len;
+	char *str = line_reader_next_str(lr, LINE_DELIM, &len);
+
+	if (!str) {
+		line->str = NULL;
+		return 0;
+	}
+	line->str = xmemdup(str, len + 1);
+	extract_keys(line, xmalloc(key_count * sizeof(line->key[0])));
+	return 1;
+}
+
+static void free_line(struct sort_line *line)
+{
+	if (line->str) {
+		free_keys(line);
+		free(line->key);
+		free(line->str);
+	}
+}
+
+/* Earlier source wins ties: keeps the merge stable */
+static int merge_before(struct merge_src *x, struct merge_src *y)
+{
+	int retval = compare_keys(&x->line, &y->line);
+	return retval < 0 || (retval == 0 && x < y);
+}
+
+static void sift_down(struct merge_src **heap, unsigned n, unsigned i)
+{
+	for (;;) {
+		struct merge_src *tmp;
+		unsigned min = i;
+		unsigned child = 2*i + 1;
+
+		if (child < n && merge_before(heap[child], heap[min]))
+			min = child;
+		child++;
+		if (child < n && merge_before(heap[child], heap[min]))
+			min = child;
+		if (min == i)
+			break;
+		tmp = heap[i];
+		heap[i] = heap[min];
+		heap[min] = tmp;
+		i = min;
+	}
+}
+
+/* K-way merge of sorted files[] into out, handling -u */
+static void merge_files(FILE **files, unsigned cnt, FILE *out)
+{
+	struct merge_src *src, **heap;
+	struct sort_line last;
+	unsigned i, n;
+	int ch = (option_mask32 & FLAG_z) ? '\0' : '\n';
+
+	src = xmalloc(cnt * sizeof(src[0]));
+	heap = xmalloc(cnt * sizeof(heap[0]));
+	n = 0;
+	for (i = 0; i < cnt; i++) {
+		src[i].lr = line_reader_fdopen(fileno(files[i]));
+		if (read_line(src[i].lr, &src[i].line))
+			heap[n++] = &src[i];
+	}
+	for (i = n / 2; i-- != 0;)
+		sift_down(heap, n, i);
+	last.str = NULL;
+
+	while (n) {
+		struct merge_src *s = heap[0];
+
+		if (last.str && (option_mask32 & FLAG_u)
+		 && compare_unique(&last, &s->line) == 0
+		) {
+			free_line(&s->line);
+		} else {
+			fprintf(out, "%s%c", s->line.str, ch);
+			free_line(&last);
+			last = s->line;
+		}
+		if (!read_line(s->lr, &s->line))
+			heap[0] = heap[--n];
+		sift_down(heap, n, 0);
+	}
+	free_line(&last);
+	for (i = 0; i < cnt; i++)
+		line_reader_free(src[i].lr);
+	free(heap);
+	free(src);
+}
+
+/* Sort lines and save them as a new run */
+static void spill_run(struct sort_line *lines, int linecount)
+{
+	FILE *fp = xtmpfile();
+	int i;
+
+	sort_and_write(fp, lines, linecount);
+	xflush_and_rewind(fp);
+	for (i = 0; i < linecount; i++)
+		free(lines[i].str);
+	run_files = xrealloc_vector(run_files, 4, run_count);
+	run_files[run_count++] = fp;
+}
+
+/* Merge runs in groups until they can be merged in one pass */
+static void reduce_runs(void)
+{
+	while (run_count > MERGE_FANIN) {
+		FILE *fp = xtmpfile();
+		unsigned i;
+
+		merge_files(run_files, MERGE_FANIN, fp);
+		xflush_and_rewind(fp);
+		for (i = 0; i < MERGE_FANIN; i++)
+			fclose(run_files[i]);
+		/* Merged run takes the place of the oldest ones:
+		 * merge_files() breaks ties by position, -s and -u
+		 * need earlier input to stay first */
+		run_files[0] = fp;
+		run_count -= MERGE_FANIN - 1;
+		memmove(run_files + 1, run_files + MERGE_FANIN, (run_count - 1) * sizeof(run_files[0]));
+	}
+}
+#endif
+
 #if ENABLE_FEATURE_SORT_BIG
 static unsigned str2u(char **str)
 {
@@ -368,20 +802,24 @@ static unsigned str2u(char **str)
 int sort_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int sort_main(int argc UNUSED_PARAM, char **argv)
 {
-	char *line, **lines;
-	char *str_ignored, *str_o, *str_t;
+	struct sort_line *lines;
+	char *str_S, *str_T, *str_o, *str_t;
+	IF_FEATURE_SORT_PARALLEL(char *str_parallel;)
 	llist_t *lst_k = NULL;
-	int i;
+	IF_FEATURE_SORT_BIG(int i;)
 	int linecount;
 	unsigned opts;
 
 	xfunc_error_retval = 2;
 
 	/* Parse command line options */
-	opts = getopt32(argv, "^"
+	opts = getopt32long(argv, "^"
 			OPT_STR
 			"\0" "o--o:t--t"/*-t, -o: at most one of each*/,
-			&str_ignored, &str_ignored, &str_o, &lst_k, &str_t
+			IF_FEATURE_SORT_PARALLEL("parallel\0" Required_argument "\xff")
+			IF_NOT_FEATURE_SORT_PARALLEL(""),
+			&str_S, &str_T, &str_o, &lst_k, &str_t
+			IF_FEATURE_SORT_PARALLEL(, &str_parallel)
 	);
 	/* global b strips leading and trailing spaces */
 	if (opts & FLAG_b)
@@ -446,33 +884,95 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	}
 #endif
 
+#if ENABLE_FEATURE_SORT_BIG
+	/* If no key, perform alphabetic sort */
+	if (!key_list)
+		add_key()->range[0] = 1;
+#endif
+#if ENABLE_FEATURE_SORT_PARALLEL
+	if (opts & FLAG_parallel)
+		nworkers = xatou_range(str_parallel, 1, 1024);
+#endif
+#if ENABLE_FEATURE_SORT_MERGE
+	tmp_dir = str_T;
+	if (!(opts & FLAG_T)) {
+		tmp_dir = getenv("TMPDIR");
+		if (!tmp_dir || !tmp_dir[0])
+			tmp_dir = "/tmp";
+	}
+	if (opts & FLAG_S) {
+		/* GNU: no suffix means kilobytes */
+		mem_limit = xatoul_sfx(str_S, sort_S_suffixes);
+		if (isdigit(str_S[strlen(str_S) - 1]))
+			mem_limit *= 1024;
+	}
+#endif
+
 	/* Open input files and read data */
 	argv += optind;
 	if (!*argv)
 		*--argv = (char*)"-";
+#if ENABLE_FEATURE_SORT_MERGE
+	if ((option_mask32 & (FLAG_m | FLAG_c)) == FLAG_m) {
+		FILE **files;
+		FILE *out = stdout;
+
+		/* Inputs are read lazily: if -o names one of them,
+		 * we must not truncate it before we are done */
+		if (option_mask32 & FLAG_o)
+			out = xtmpfile();
+		files = xzalloc(string_array_len(argv) * sizeof(files[0]));
+		for (i = 0; argv[i]; i++)
+			files[i] = xfopen_stdin(argv[i]);
+		merge_files(files, i, out);
+		if (out != stdout) {
+			xflush_and_rewind(out);
+			xmove_fd(xopen(str_o, O_WRONLY|O_CREAT|O_TRUNC), STDOUT_FILENO);
+			bb_copyfd_eof(fileno(out), STDOUT_FILENO);
+		}
+		fflush_stdout_and_exit(EXIT_SUCCESS);
+	}
+	/* -c must see all lines */
+	if (option_mask32 & FLAG_c)
+		mem_limit = 0;
+#endif
 	linecount = 0;
 	lines = NULL;
 	do {
 		/* coreutils 6.9 compat: abort on first open error,
 		 * do not continue to next file: */
-		FILE *fp = xfopen_stdin(*argv);
+		int fd = xopen_stdin(*argv);
+		line_reader_t *lr = line_reader_fdopen(fd);
 		for (;;) {
-			line = GET_LINE(fp);
+			size_t len;
+			char *line = line_reader_next_str(lr, LINE_DELIM, &len);
 			if (!line)
 				break;
 			lines = xrealloc_vector(lines, 6, linecount);
-			lines[linecount++] = line;
+			lines[linecount++].str = xmemdup(line, len + 1);
+#if ENABLE_FEATURE_SORT_MERGE
+			if (mem_limit) {
+				/* Rough estimate of malloc overhead included */
+				mem_used += len + 1 + 2 * sizeof(long)
+					+ sizeof(lines[0]) + key_count * sizeof(struct key_val);
+				if (mem_used > mem_limit) {
+					spill_run(lines, linecount);
+					linecount = 0;
+					mem_used = 0;
+				}
+			}
+#endif
 		}
-		fclose_if_not_stdin(fp);
+		line_reader_free(lr);
+		if (fd != STDIN_FILENO)
+			close(fd);
 	} while (*++argv);
 
 #if ENABLE_FEATURE_SORT_BIG
-	/* If no key, perform alphabetic sort */
-	if (!key_list)
-		add_key()->range[0] = 1;
 	/* Handle -c */
 	if (option_mask32 & FLAG_c) {
 		int j = (option_mask32 & FLAG_u) ? -1 : 0;
+		extract_all_keys(lines, linecount);
 		for (i = 1; i < linecount; i++) {
 			if (compare_keys(&lines[i-1], &lines[i]) > j) {
 				fprintf(stderr, "Check line %u\n", i);
@@ -482,24 +982,13 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 		return EXIT_SUCCESS;
 	}
 #endif
-	/* Perform the actual sort */
-	qsort(lines, linecount, sizeof(lines[0]), compare_keys);
-
-	/* Handle -u */
-	if (option_mask32 & FLAG_u) {
-		int j = 0;
-		/* coreutils 6.3 drop lines for which only key is the same */
-		/* -- disabling last-resort compare... */
-		option_mask32 |= FLAG_s;
-		for (i = 1; i < linecount; i++) {
-			if (compare_keys(&lines[j], &lines[i]) == 0)
-				free(lines[i]);
-			else
-				lines[++j] = lines[i];
-		}
+#if ENABLE_FEATURE_SORT_MERGE
+	if (run_count) {
 		if (linecount)
-			linecount = j+1;
+			spill_run(lines, linecount);
+		reduce_runs();
 	}
+#endif
 
 	/* Print it */
 #if ENABLE_FEATURE_SORT_BIG
@@ -507,11 +996,12 @@ int sort_main(int argc UNUSED_PARAM, char **argv)
 	if (option_mask32 & FLAG_o)
 		xmove_fd(xopen(str_o, O_WRONLY|O_CREAT|O_TRUNC), STDOUT_FILENO);
 #endif
-	{
-		int ch = (option_mask32 & FLAG_z) ? '\0' : '\n';
-		for (i = 0; i < linecount; i++)
-			printf("%s%c", lines[i], ch);
-	}
+#if ENABLE_FEATURE_SORT_MERGE
+	if (run_count)
+		merge_files(run_files, run_count, stdout);
+	else
+#endif
+		sort_and_write(stdout, lines, linecount);
 
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -272,12 +272,13 @@ int tail_main(int argc, char **argv)
 						seen += nread;
 					} else {
 						char *s = buf;
-						do {
-							--nwrite;
-							if (*s++ == '\n' && ++seen == count) {
+						char *end = buf + nread;
+						while ((s = memchr(s, '\n', end - s)) != NULL) {
+							s++;
+							if (++seen == count)
 								break;
-							}
-						} while (nwrite);
+						}
+						nwrite = s ? end - s : 0;
 					}
 				}
 				if (nwrite > 0)
@@ -290,15 +291,9 @@ int tail_main(int argc, char **argv)
 						taillen = count;
 					}
 				} else {
-					int k = nread;
-					int newlines_in_buf = 0;
-
-					do { /* count '\n' in last read */
-						k--;
-						if (buf[k] == '\n') {
-							newlines_in_buf++;
-						}
-					} while (k);
+					int k;
+					/* count '\n' in last read */
+					int newlines_in_buf = bb_memcount(buf, '\n', nread);
 
 					if (newlines_seen + newlines_in_buf < (int)count) {
 						newlines_seen += newlines_in_buf;
@@ -310,10 +305,8 @@ int tail_main(int argc, char **argv)
 						k = newlines_seen + newlines_in_buf + extra - count;
 						s = tailbuf;
 						while (k) {
-							if (*s == '\n') {
-								k--;
-							}
-							s++;
+							s = (char*)memchr(s, '\n', buf + nread - s) + 1;
+							k--;
 						}
 						taillen += nread - (s - tailbuf);
 						memmove(tailbuf, s, taillen);
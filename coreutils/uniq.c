@@ -47,6 +47,9 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 	unsigned opt;
 	char *cur_line;
 	const char *cur_compare;
+	line_reader_t *lr;
+	char *old_buf;
+	size_t old_buf_size, cur_len;
 
 	enum {
 		OPT_c = 0x1,
@@ -85,6 +88,9 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+	lr = line_reader_fdopen(STDIN_FILENO);
+	old_buf = NULL;
+	old_buf_size = 0;
 	cur_compare = cur_line = NULL; /* prime the pump */
 
 	do {
@@ -95,10 +101,20 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 
 		old_line = cur_line;
 		old_compare = cur_compare;
+		/* Next line overwrites this one */
+		if (old_line) {
+			if (old_buf_size <= cur_len) {
+				old_buf_size = cur_len + 1;
+				free(old_buf);
+				old_buf = xmalloc(old_buf_size);
+			}
+			old_compare = old_buf + (old_compare - old_line);
+			old_line = memcpy(old_buf, old_line, cur_len + 1);
+		}
 		dups = 0;
 
 		/* gnu uniq ignores newlines */
-		while ((cur_line = xmalloc_fgetline(stdin)) != NULL) {
+		while ((cur_line = line_reader_next_str(lr, '\n', &cur_len)) != NULL) {
 			cur_compare = cur_line;
 			for (i = skip_fields; i; i--) {
 				cur_compare = skip_whitespace(cur_compare);
@@ -117,7 +133,6 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 				break;
 			}
 
-			free(cur_line);
 			++dups;  /* testing for overflow seems excessive */
 		}
 
@@ -129,11 +144,8 @@ int uniq_main(int argc UNUSED_PARAM, char **argv)
 				}
 				puts(old_line);
 			}
-			free(old_line);
 		}
 	} while (cur_line);
 
-	die_if_ferror(stdin, input_filename);
-
 	fflush_stdout_and_exit(EXIT_SUCCESS);
 }
@@ -31,6 +31,9 @@
  *      (dd ibs=1k skip=1 count=0 &> /dev/null; wc -c) < /tmp/testfile
  *
  * for which 'wc -c' should output '0'.
+ *
+ * count_lines_and_bytes() below does use fstat for -c of regular files,
+ * taking the file position into account as described above.
  */
 //config:config WC
 //config:	bool "wc (4.4 kb)"
@@ -105,6 +108,40 @@ enum {
 	NUM_WCS     = 5,
 };
 
+/* Fast path for -l and/or -c: no per-char state machine.
+ * Returns nonzero on read error.
+ */
+static int count_lines_and_bytes(int fd, COUNT_T *counts, unsigned print_type)
+{
+	enum { BUFSZ = 128 * 1024 };
+	char *buf;
+	ssize_t r;
+
+	if (!(print_type & (1 << WC_LINES))) {
+		struct stat st;
+		off_t pos;
+
+		/* Exclude size 0 files, they may be in /proc */
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+			pos = lseek(fd, 0, SEEK_CUR);
+			if (pos >= 0) {
+				if (pos < st.st_size)
+					counts[WC_BYTES] = st.st_size - pos;
+				lseek(fd, 0, SEEK_END);
+				return 0;
+			}
+		}
+	}
+
+	buf = xmalloc(BUFSZ);
+	while ((r = safe_read(fd, buf, BUFSZ)) > 0) {
+		counts[WC_BYTES] += r;
+		counts[WC_LINES] += bb_memcount(buf, '\n', r);
+	}
+	free(buf);
+	return r;
+}
+
 int wc_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int wc_main(int argc UNUSED_PARAM, char **argv)
 {
@@ -159,6 +196,14 @@ int wc_main(int argc UNUSED_PARAM, char **argv)
 		linepos = 0;
 		in_word = 0;
 
+		if (!(print_type & ~((1 << WC_LINES) | (1 << WC_BYTES)))) {
+			if (count_lines_and_bytes(fileno(fp), counts, print_type) != 0) {
+				bb_simple_perror_msg(arg);
+				status = EXIT_FAILURE;
+			}
+			goto DONE;
+		}
+
 		while (1) {
 			int c;
 			/* Our -w doesn't match GNU wc exactly... oh well */
@@ -217,7 +262,7 @@ int wc_main(int argc UNUSED_PARAM, char **argv)
 				break;
 			}
 		}
-
+ DONE:
 		fclose_if_not_stdin(fp);
 
 		if (totals[WC_LENGTH] < counts[WC_LENGTH]) {
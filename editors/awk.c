@@ -157,16 +157,42 @@ typedef struct hash_item_s {
 		struct rstream_s rs;    /* redirect streams hash */
 		struct func_s f;        /* functions hash */
 	} data;
-	struct hash_item_s *next;       /* next in chain */
+	struct hash_item_s *next;       /* insertion order, for for..in */
+	struct hash_item_s *prev;
 	char name[1];                   /* really it's longer */
 } hash_item;
 
+/* Open addressing: a slot keeps the full hash of its item, so probing
+ * rarely has to look at the item itself. Items do not move once created
+ * (pointers to their data are kept all over the place) */
+typedef struct hash_slot_s {
+	unsigned hval;
+	struct hash_item_s *item;       /* NULL: empty slot */
+} hash_slot;
+
+/* Items up to this size are carved from per-hash arena chunks,
+ * removed ones are kept on per-size free lists for reuse */
+#define HASH_ITEM_ALIGN   16
+#define HASH_SMALL_ITEM   128
+#define HASH_CHUNK_MIN    512
+#define HASH_CHUNK_MAX    (64 * 1024)
+
+typedef struct hash_chunk_s {
+	struct hash_chunk_s *next;
+} hash_chunk;
+
 typedef struct xhash_s {
 	unsigned nel;           /* num of elements */
-	unsigned csize;         /* current hash size */
-	unsigned nprime;        /* next hash size in PRIMES[] */
+	unsigned csize;         /* current hash size, power of 2 */
 	unsigned glen;          /* summary length of item names */
-	struct hash_item_s **items;
+	struct hash_slot_s *items;
+	struct hash_item_s *first;
+	struct hash_item_s *last;
+	char *arena;            /* free tail of the newest chunk */
+	unsigned arena_left;
+	unsigned chunk_size;
+	struct hash_chunk_s *chunks;
+	struct hash_item_s *freed[HASH_SMALL_ITEM / HASH_ITEM_ALIGN];
 } xhash;
 
 /* Tree node */
@@ -179,6 +205,7 @@ typedef struct node_s {
 		int aidx;
 		char *new_progname;
 		regex_t *re;
+		struct numcode_s *code;
 	} l;
 	union {
 		struct node_s *n;
@@ -190,6 +217,17 @@ typedef struct node_s {
 	} a;
 } node;
 
+/* Arithmetic expression compiled to a linear stack machine program,
+ * see compile_numcode() */
+typedef struct numcode_s {
+	unsigned char op;
+	union {
+		double d;
+		var *v;
+		int aidx;
+	} u;
+} numcode;
+
 /* Block of temporary variables */
 typedef struct nvblock_s {
 	int size;
@@ -204,6 +242,13 @@ typedef struct tsplitter_s {
 	regex_t re[2];
 } tsplitter;
 
+/* Compiled dynamic regex, see as_regex() */
+typedef struct re_cache_s {
+	char *pat;
+	int cflags;
+	regex_t re;
+} re_cache;
+
 /* simple token classes */
 /* Order and hex values are very important!!!  See next_token() */
 #define	TC_SEQSTART	(1 << 0)		/* ( */
@@ -281,6 +326,7 @@ typedef struct tsplitter_s {
 #define	OF_STR2    0x080000
 #define	OF_NUM1    0x100000
 #define	OF_CHECKED 0x200000
+#define	OF_NOCODE  0x400000	/* can't be compiled to numcode */
 
 /* combined operator flags */
 #define	xx	0
@@ -329,7 +375,7 @@ enum {
 	OC_MOVE = 0x1f00,       OC_PGETLINE = 0x2000,   OC_REGEXP = 0x2100,
 	OC_REPLACE = 0x2200,    OC_RETURN = 0x2300,     OC_SPRINTF = 0x2400,
 	OC_TERNARY = 0x2500,    OC_UNARY = 0x2600,      OC_VAR = 0x2700,
-	OC_DONE = 0x2800,
+	OC_DONE = 0x2800,       OC_NUMCODE = 0x2900,
 
 	ST_IF = 0x3000,         ST_DO = 0x3100,         ST_FOR = 0x3200,
 	ST_WHILE = 0x3300
@@ -468,9 +514,11 @@ static const char vValues[] ALIGN1 =
 	"\n\0"      "\n\0"      "\0"        "\0"
 	"\034\0"    "\0"        "\377";
 
-/* hash size may grow to these values */
-#define FIRST_PRIME 61
-static const uint16_t PRIMES[] ALIGN2 = { 251, 1021, 4093, 16381, 65521 };
+/* initial hash size, doubles when 3/4 full */
+#define FIRST_HASH_SIZE 16
+
+/* How many compiled dynamic regexes to keep */
+#define RE_CACHE_SIZE 16
 
 
 /* Globals. Split in two parts so that first one is addressed
@@ -488,6 +536,7 @@ struct globals {
 	const char *g_progname;
 	int g_lineno;
 	int nfields;
+	int nfields_split; /* Fields[] before this one are set up */
 	int maxfields; /* used in fsrealloc() only */
 	var *Fields;
 	nvblock *g_cb;
@@ -510,6 +559,8 @@ struct globals2 {
 
 	/* former statics from various functions */
 	char *split_f0__fstrings;
+	char *split_f0__pos;
+	char split_f0__c[4];
 
 	uint32_t next_token__save_tclass;
 	uint32_t next_token__save_info;
@@ -521,11 +572,12 @@ struct globals2 {
 
 	var *evaluate__fnargs;
 	unsigned evaluate__seed;
-	regex_t evaluate__sreg;
 
 	var ptest__v;
 
-	tsplitter exec_builtin__tspl;
+	node exec_builtin__tspl;
+
+	re_cache *cached_regex__cache[RE_CACHE_SIZE];
 
 	/* biggest and least used members go last */
 	tsplitter fsplitter, rsplitter;
@@ -552,6 +604,7 @@ struct globals2 {
 #define g_progname   (G1.g_progname  )
 #define g_lineno     (G1.g_lineno    )
 #define nfields      (G1.nfields     )
+#define nfields_split (G1.nfields_split)
 #define maxfields    (G1.maxfields   )
 #define Fields       (G1.Fields      )
 #define g_cb         (G1.g_cb        )
@@ -618,6 +671,10 @@ static unsigned hashidx(const char *name)
 
 	while (*name)
 		idx = *name++ + (idx << 6) - idx;
+	/* mix high bits into the low ones used for indexing */
+	idx ^= idx >> 16;
+	idx *= 0x45d9f3b;
+	idx ^= idx >> 16;
 	return idx;
 }
 
@@ -627,47 +684,112 @@ static xhash *hash_init(void)
 	xhash *newhash;
 
 	newhash = xzalloc(sizeof(*newhash));
-	newhash->csize = FIRST_PRIME;
-	newhash->items = xzalloc(FIRST_PRIME * sizeof(newhash->items[0]));
+	newhash->csize = FIRST_HASH_SIZE;
+	newhash->items = xzalloc(FIRST_HASH_SIZE * sizeof(newhash->items[0]));
 
 	return newhash;
 }
 
+static unsigned hash_item_size(unsigned namelen)
+{
+	return (offsetof(hash_item, name) + namelen + 1 + HASH_ITEM_ALIGN - 1)
+		& ~(HASH_ITEM_ALIGN - 1);
+}
+
+/* get zeroed memory for an item */
+static hash_item *hash_item_alloc(xhash *hash, unsigned size)
+{
+	hash_item **pfree;
+	hash_item *hi;
+
+	if (size > HASH_SMALL_ITEM)
+		return xzalloc(size);
+
+	pfree = &hash->freed[size / HASH_ITEM_ALIGN - 1];
+	hi = *pfree;
+	if (hi) {
+		*pfree = *(hash_item **)hi;
+	} else {
+		if (hash->arena_left < size) {
+			hash_chunk *c;
+			unsigned csize = hash->chunk_size * 2;
+
+			if (csize < HASH_CHUNK_MIN)
+				csize = HASH_CHUNK_MIN;
+			if (csize > HASH_CHUNK_MAX)
+				csize = HASH_CHUNK_MAX;
+			hash->chunk_size = csize;
+			c = xmalloc(csize);
+			c->next = hash->chunks;
+			hash->chunks = c;
+			hash->arena = (char *)c + HASH_ITEM_ALIGN;
+			hash->arena_left = csize - HASH_ITEM_ALIGN;
+		}
+		hi = (hash_item *)hash->arena;
+		hash->arena += size;
+		hash->arena_left -= size;
+	}
+	memset(hi, 0, size);
+	return hi;
+}
+
+static void hash_item_free(xhash *hash, hash_item *hi, unsigned size)
+{
+	hash_item **pfree;
+
+	if (size > HASH_SMALL_ITEM) {
+		free(hi);
+		return;
+	}
+	pfree = &hash->freed[size / HASH_ITEM_ALIGN - 1];
+	*(hash_item **)hi = *pfree;
+	*pfree = hi;
+}
+
+/* find slot of the item, or the empty slot where it would go */
+static hash_slot *hash_lookup(xhash *hash, const char *name, unsigned hval)
+{
+	unsigned mask = hash->csize - 1;
+	unsigned i = hval & mask;
+	hash_slot *slot;
+
+	for (;;) {
+		slot = &hash->items[i];
+		if (!slot->item
+		 || (slot->hval == hval && strcmp(slot->item->name, name) == 0)
+		) {
+			return slot;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
 /* find item in hash, return ptr to data, NULL if not found */
 static void *hash_search(xhash *hash, const char *name)
 {
 	hash_item *hi;
 
-	hi = hash->items[hashidx(name) % hash->csize];
-	while (hi) {
-		if (strcmp(hi->name, name) == 0)
-			return &hi->data;
-		hi = hi->next;
-	}
-	return NULL;
+	hi = hash_lookup(hash, name, hashidx(name))->item;
+	return hi ? &hi->data : NULL;
 }
 
 /* grow hash if it becomes too big */
 static void hash_rebuild(xhash *hash)
 {
-	unsigned newsize, i, idx;
-	hash_item **newitems, *hi, *thi;
+	unsigned newsize, mask, i, idx;
+	hash_slot *newitems;
 
-	if (hash->nprime == ARRAY_SIZE(PRIMES))
-		return;
-
-	newsize = PRIMES[hash->nprime++];
+	newsize = hash->csize * 2;
+	mask = newsize - 1;
 	newitems = xzalloc(newsize * sizeof(newitems[0]));
 
 	for (i = 0; i < hash->csize; i++) {
-		hi = hash->items[i];
-		while (hi) {
-			thi = hi;
-			hi = thi->next;
-			idx = hashidx(thi->name) % newsize;
-			thi->next = newitems[idx];
-			newitems[idx] = thi;
-		}
+		if (!hash->items[i].item)
+			continue;
+		idx = hash->items[i].hval & mask;
+		while (newitems[idx].item)
+			idx = (idx + 1) & mask;
+		newitems[idx] = hash->items[i];
 	}
 
 	free(hash->items);
@@ -678,23 +800,33 @@ static void hash_rebuild(xhash *hash)
 /* find item in hash, add it if necessary. Return ptr to data */
 static void *hash_find(xhash *hash, const char *name)
 {
+	hash_slot *slot;
 	hash_item *hi;
-	unsigned idx;
+	unsigned hval;
 	int l;
 
-	hi = hash_search(hash, name);
+	hval = hashidx(name);
+	slot = hash_lookup(hash, name, hval);
+	hi = slot->item;
 	if (!hi) {
-		if (++hash->nel / hash->csize > 10)
+		if (++hash->nel > hash->csize / 4 * 3) {
 			hash_rebuild(hash);
+			slot = hash_lookup(hash, name, hval);
+		}
 
-		l = strlen(name) + 1;
-		hi = xzalloc(sizeof(*hi) + l);
-		strcpy(hi->name, name);
+		l = strlen(name);
+		hi = hash_item_alloc(hash, hash_item_size(l));
+		memcpy(hi->name, name, l + 1);
 
-		idx = hashidx(name) % hash->csize;
-		hi->next = hash->items[idx];
-		hash->items[idx] = hi;
-		hash->glen += l;
+		slot->hval = hval;
+		slot->item = hi;
+		hi->prev = hash->last;
+		if (hash->last)
+			hash->last->next = hi;
+		else
+			hash->first = hi;
+		hash->last = hi;
+		hash->glen += l + 1;
 	}
 	return &hi->data;
 }
@@ -706,20 +838,37 @@ static void *hash_find(xhash *hash, const char *name)
 
 static void hash_remove(xhash *hash, const char *name)
 {
-	hash_item *hi, **phi;
+	unsigned mask = hash->csize - 1;
+	unsigned i, j, l;
+	hash_slot *slot;
+	hash_item *hi;
 
-	phi = &hash->items[hashidx(name) % hash->csize];
-	while (*phi) {
-		hi = *phi;
-		if (strcmp(hi->name, name) == 0) {
-			hash->glen -= (strlen(name) + 1);
-			hash->nel--;
-			*phi = hi->next;
-			free(hi);
+	slot = hash_lookup(hash, name, hashidx(name));
+	hi = slot->item;
+	if (!hi)
+		return;
+
+	*(hi->prev ? &hi->prev->next : &hash->first) = hi->next;
+	*(hi->next ? &hi->next->prev : &hash->last) = hi->prev;
+	l = strlen(name);
+	hash->glen -= l + 1;
+	hash->nel--;
+	hash_item_free(hash, hi, hash_item_size(l));
+
+	/* Close the gap: move back following items which
+	 * would not be found past the now empty slot */
+	i = slot - hash->items;
+	j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!hash->items[j].item)
 			break;
+		if (((j - hash->items[j].hval) & mask) >= ((j - i) & mask)) {
+			hash->items[i] = hash->items[j];
+			i = j;
 		}
-		phi = &hi->next;
 	}
+	hash->items[i].item = NULL;
 }
 
 /* ------ some useful functions ------ */
@@ -827,18 +976,25 @@ static xhash *iamarray(var *v)
 static void clear_array(xhash *array)
 {
 	unsigned i;
-	hash_item *hi, *thi;
+	hash_item *hi;
+	hash_chunk *c;
 
 	for (i = 0; i < array->csize; i++) {
-		hi = array->items[i];
-		while (hi) {
-			thi = hi;
-			hi = hi->next;
-			free(thi->data.v.string);
-			free(thi);
+		hi = array->items[i].item;
+		if (hi) {
+			free(hi->data.v.string);
+			if (hash_item_size(strlen(hi->name)) > HASH_SMALL_ITEM)
+				free(hi);
+			array->items[i].item = NULL;
 		}
-		array->items[i] = NULL;
 	}
+	while ((c = array->chunks) != NULL) {
+		array->chunks = c->next;
+		free(c);
+	}
+	array->arena_left = array->chunk_size = 0;
+	memset(array->freed, 0, sizeof(array->freed));
+	array->first = array->last = NULL;
 	array->glen = array->nel = 0;
 }
 
@@ -1665,34 +1821,65 @@ static node *mk_splitter(const char *s, tsplitter *spl)
 	return n;
 }
 
-/* use node as a regular expression. Supplied with node ptr and regex_t
- * storage space. Return ptr to regex (if result points to preg, it should
- * be later regfree'd manually
+/* Compile a dynamic regex, unless it is one of the RE_CACHE_SIZE
+ * most recently used ones. The result is owned by the cache, and stays
+ * valid until the next call.
  */
-static regex_t *as_regex(node *op, regex_t *preg)
+static regex_t *cached_regex(const char *s, int cflags)
 {
-	int cflags;
-	var *v;
-	const char *s;
+	re_cache **cache = G.cached_regex__cache;
+	re_cache *c;
+	char *errmsg;
+	int i;
 
-	if ((op->info & OPCLSMASK) == OC_REGEXP) {
-		return icase ? op->r.ire : op->l.re;
+	/* cache[] is kept in most recently used first order */
+	for (i = 0; i < RE_CACHE_SIZE && cache[i]; i++) {
+		c = cache[i];
+		if (c->cflags == cflags && strcmp(c->pat, s) == 0)
+			goto found;
 	}
-	v = nvalloc(1);
-	s = getvar_s(evaluate(op, v));
-
-	cflags = icase ? REG_EXTENDED | REG_ICASE : REG_EXTENDED;
+	if (i == RE_CACHE_SIZE) {
+		/* full: reuse the least recently used one */
+		c = cache[--i];
+		regfree(&c->re);
+		free(c->pat);
+	} else {
+		c = xmalloc(sizeof(*c));
+	}
+	c->pat = xstrdup(s);
+	c->cflags = cflags;
 	/* Testcase where REG_EXTENDED fails (unpaired '{'):
 	 * echo Hi | awk 'gsub("@(samp|code|file)\{","");'
 	 * gawk 3.1.5 eats this. We revert to ~REG_EXTENDED
 	 * (maybe gsub is not supposed to use REG_EXTENDED?).
 	 */
-	if (regcomp(preg, s, cflags)) {
-		cflags &= ~REG_EXTENDED;
-		xregcomp(preg, s, cflags);
+	errmsg = regcomp_or_errmsg(&c->re, s, cflags);
+	if (errmsg) {
+		free(errmsg);
+		xregcomp(&c->re, s, cflags & ~REG_EXTENDED);
 	}
+ found:
+	memmove(cache + 1, cache, i * sizeof(cache[0]));
+	cache[0] = c;
+	return &c->re;
+}
+
+/* use node as a regular expression. Return ptr to regex, which should
+ * not be freed (see cached_regex)
+ */
+static regex_t *as_regex(node *op)
+{
+	var *v;
+	regex_t *re;
+
+	if ((op->info & OPCLSMASK) == OC_REGEXP) {
+		return icase ? op->r.ire : op->l.re;
+	}
+	v = nvalloc(1);
+	re = cached_regex(getvar_s(evaluate(op, v)),
+			icase ? REG_EXTENDED | REG_ICASE : REG_EXTENDED);
 	nvfree(v);
-	return preg;
+	return re;
 }
 
 /* gradually increasing buffer.
@@ -1726,6 +1913,10 @@ static void fsrealloc(int size)
 	for (i = size; i < nfields; i++) {
 		clrvar(Fields + i);
 	}
+	/* Fields[] are normally fully set up when we get here,
+	 * split_f0_upto() resets nfields_split after calling us */
+	if (nfields_split >= nfields || nfields_split > size)
+		nfields_split = size > 0 ? size : 0;
 	nfields = size;
 }
 
@@ -1810,33 +2001,101 @@ static int awk_split(const char *s, node *spl, char **slist)
 	return n;
 }
 
-static void split_f0(void)
+/* Split $0 into fields, as far as $n. With space or single char FS,
+ * we only count the fields first (so that NF is known and Fields[]
+ * is not reallocated under our callers later), and cut them out of
+ * a copy of $0 on demand: "{ print $1 }" on a record with a hundred
+ * fields does not have to set up all of them.
+ */
+static void split_f0_upto(int n)
 {
 /* static char *fstrings; */
 #define fstrings (G.split_f0__fstrings)
+#define pos      (G.split_f0__pos     )
+#define c        (G.split_f0__c       )
 
-	int i, n;
+	int i;
 	char *s;
 
-	if (is_f0_split)
-		return;
+	if (!is_f0_split) {
+		uint32_t fs = fsplitter.n.info;
 
-	is_f0_split = TRUE;
-	free(fstrings);
-	fsrealloc(0);
-	n = awk_split(getvar_s(intvar[F0]), &fsplitter.n, &fstrings);
-	fsrealloc(n);
-	s = fstrings;
-	for (i = 0; i < n; i++) {
-		Fields[i].string = nextword(&s);
-		Fields[i].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+		is_f0_split = TRUE;
+		free(fstrings);
+		fsrealloc(0);
+		if ((fs & OPCLSMASK) == OC_REGEXP || (char)fs == '\0') {
+			/* regex or null split: split it all now */
+			i = awk_split(getvar_s(intvar[F0]), &fsplitter.n, &fstrings);
+			fsrealloc(i);
+			s = fstrings;
+			for (i = 0; i < nfields; i++) {
+				Fields[i].string = nextword(&s);
+				Fields[i].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+			}
+		} else {
+			/* same separators as in awk_split() */
+			pos = fstrings = xstrdup(getvar_s(intvar[F0]));
+			c[0] = c[1] = (char)fs;
+			c[2] = c[3] = '\0';
+			if (*getvar_s(intvar[RS]) == '\0')
+				c[2] = '\n';
+			i = 0;
+			if (c[0] == ' ') {
+				s = fstrings;
+				while (*(s = skip_whitespace(s)) != '\0') {
+					i++;
+					while (*s && !isspace(*s))
+						s++;
+				}
+			} else if (*fstrings) {
+				size_t len = strlen(fstrings);
+				if (icase) {
+					c[0] = toupper(c[0]);
+					c[1] = tolower(c[1]);
+				}
+				i = 1 + bb_memcount(fstrings, c[0], len);
+				if (c[1] != c[0])
+					i += bb_memcount(fstrings, c[1], len);
+				if (c[2] && c[2] != c[0] && c[2] != c[1])
+					i += bb_memcount(fstrings, c[2], len);
+			}
+			fsrealloc(i);
+			nfields_split = 0;
+		}
+
+		/* set NF manually to avoid side effects */
+		clrvar(intvar[NF]);
+		intvar[NF]->type = VF_NUMBER | VF_SPECIAL;
+		intvar[NF]->number = nfields;
 	}
 
-	/* set NF manually to avoid side effects */
-	clrvar(intvar[NF]);
-	intvar[NF]->type = VF_NUMBER | VF_SPECIAL;
-	intvar[NF]->number = nfields;
+	/* cut out fields up to $n */
+	for (i = nfields_split; i < n && i < nfields; i++) {
+		if (c[0] == ' ') {
+			s = pos = skip_whitespace(pos);
+			while (*pos && !isspace(*pos))
+				pos++;
+		} else {
+			s = pos;
+			pos = strpbrk(pos, c);
+			if (!pos)
+				pos = s + strlen(s);
+		}
+		if (*pos)
+			*pos++ = '\0';
+		Fields[i].string = s;
+		Fields[i].type |= (VF_FSTR | VF_USER | VF_DIRTY);
+	}
+	if (nfields_split < i)
+		nfields_split = i;
 #undef fstrings
+#undef pos
+#undef c
+}
+
+static void split_f0(void)
+{
+	split_f0_upto(INT_MAX);
 }
 
 /* perform additional actions when some internal variables changed */
@@ -1852,6 +2111,10 @@ static void handle_special(var *v)
 
 	if (v == intvar[NF]) {
 		n = (int)getvar_i(v);
+		if (n < 0)
+			syntax_error("Negative value assigned to NF");
+		if (is_f0_split)
+			split_f0(); /* cut out the rest of fields */
 		fsrealloc(n);
 
 		/* recalculate $0 */
@@ -1889,7 +2152,7 @@ static void handle_special(var *v)
 		 *
 		 * So, split up current line before assignment to FS:
 		 */
-		split_f0();
+		split_f0_upto(0);
 
 		mk_splitter(getvar_s(v), &fsplitter);
 	} else if (v == intvar[RS]) {
@@ -1921,7 +2184,6 @@ static node *nextarg(node **pn)
 static void hashwalk_init(var *v, xhash *array)
 {
 	hash_item *hi;
-	unsigned i;
 	walker_list *w;
 	walker_list *prev_walker;
 
@@ -1937,13 +2199,9 @@ static void hashwalk_init(var *v, xhash *array)
 	debug_printf_walker(" walker@%p=%p\n", &v->x.walker, w);
 	w->cur = w->end = w->wbuf;
 	w->prev = prev_walker;
-	for (i = 0; i < array->csize; i++) {
-		hi = array->items[i];
-		while (hi) {
-			strcpy(w->end, hi->name);
-			nextword(&w->end);
-			hi = hi->next;
-		}
+	for (hi = array->first; hi; hi = hi->next) {
+		strcpy(w->end, hi->name);
+		nextword(&w->end);
 	}
 }
 
@@ -2073,6 +2331,30 @@ static int awk_getline(rstream *rsm, var *v)
 	return r;
 }
 
+/* Same as snprintf(b, size, "%lld", n), but much cheaper */
+static int fmt_int(char *b, int size, long long n)
+{
+	char buf[sizeof(n) * 3 + 2];
+	char *p = buf + sizeof(buf);
+	unsigned long long u = n;
+	int r;
+
+	if (n < 0)
+		u = -u;
+	do {
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (n < 0)
+		*--p = '-';
+	r = buf + sizeof(buf) - p;
+	if (r >= size)
+		return snprintf(b, size, "%"LL_FMT"d", n);
+	memcpy(b, p, r);
+	b[r] = '\0';
+	return r;
+}
+
 static int fmt_num(char *b, int size, const char *format, double n, int int_as_int)
 {
 	int r = 0;
@@ -2080,7 +2362,7 @@ static int fmt_num(char *b, int size, const char *format, double n, int int_as_i
 	const char *s = format;
 
 	if (int_as_int && n == (long long)n) {
-		r = snprintf(b, size, "%"LL_FMT"d", (long long)n);
+		r = fmt_int(b, size, (long long)n);
 	} else {
 		do { c = *s; } while (c && *++s);
 		if (strchr("diouxX", c)) {
@@ -2166,13 +2448,13 @@ static int awk_sub(node *rn, const char *repl, int nm, var *src, var *dest, int
 	int match_no, residx, replen, resbufsize = 0;
 	int regexec_flags;
 	regmatch_t pmatch[10];
-	regex_t sreg, *regex;
+	regex_t *regex;
 
 	resbuf = NULL;
 	residx = 0;
 	match_no = 0;
 	regexec_flags = 0;
-	regex = as_regex(rn, &sreg);
+	regex = as_regex(rn);
 	sp = getvar_s(src ? src : intvar[F0]);
 	replen = strlen(repl);
 	while (regexec(regex, sp, 10, pmatch, regexec_flags) == 0) {
@@ -2245,8 +2527,6 @@ static int awk_sub(node *rn, const char *repl, int nm, var *src, var *dest, int
  ret:
 	//bb_error_msg("end sp:'%s'%p", sp,sp);
 	setvar_p(dest ? dest : intvar[F0], resbuf);
-	if (regex == &sreg)
-		regfree(regex);
 	return match_no;
 }
 
@@ -2287,7 +2567,7 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 	var *av[4];
 	const char *as[4];
 	regmatch_t pmatch[2];
-	regex_t sreg, *re;
+	regex_t *re;
 	node *spl;
 	uint32_t isr, info;
 	int nargs;
@@ -2326,8 +2606,20 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 		char *s, *s1;
 
 		if (nargs > 2) {
-			spl = (an[2]->info & OPCLSMASK) == OC_REGEXP ?
-				an[2] : mk_splitter(getvar_s(evaluate(an[2], &tv[2])), &tspl);
+			spl = an[2];
+			if ((spl->info & OPCLSMASK) != OC_REGEXP) {
+				/* Unlike FS, a dynamic separator is likely
+				 * to change often: use cached regexes */
+				const char *sep = getvar_s(evaluate(spl, &tv[2]));
+				spl = &tspl;
+				if (sep[0] && sep[1]) { /* strlen(sep) > 1 */
+					spl->info = OC_REGEXP;
+					spl->l.re = spl->r.ire = cached_regex(sep,
+						icase ? REG_EXTENDED | REG_ICASE : REG_EXTENDED);
+				} else {
+					spl->info = (uint32_t) sep[0];
+				}
+			}
 		} else {
 			spl = &fsplitter.n;
 		}
@@ -2441,7 +2733,7 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 		break;
 
 	case B_ma:
-		re = as_regex(an[1], &sreg);
+		re = as_regex(an[1]);
 		n = regexec(re, as[0], 1, pmatch, 0);
 		if (n == 0) {
 			pmatch[0].rm_so++;
@@ -2453,8 +2745,6 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 		setvar_i(newvar("RSTART"), pmatch[0].rm_so);
 		setvar_i(newvar("RLENGTH"), pmatch[0].rm_eo - pmatch[0].rm_so);
 		setvar_i(res, pmatch[0].rm_so);
-		if (re == &sreg)
-			regfree(re);
 		break;
 
 	case B_ge:
@@ -2475,6 +2765,171 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 #undef tspl
 }
 
+/*
+ * Arithmetic expressions made of plain variables, constants and fields,
+ * like "s + $3 * 2", are compiled on first use to a linear program for
+ * a small stack machine. Running it does not recurse into evaluate()
+ * and allocate temporaries for every node of the tree.
+ */
+enum {
+	NC_END, NC_VAR, NC_FNARG, NC_FIELD, NC_NEG,
+	NC_ADD, NC_SUB, NC_MUL, NC_DIV, NC_MOD, NC_POW,
+};
+#define NUMCODE_MAX  32 /* instructions */
+#define NUMSTACK_MAX 8
+
+/* Append code for subtree n, return stack depth it needs
+ * or -1 if it can't be compiled */
+static int gen_numcode(node *n, numcode *code, int *len)
+{
+	int d1, d2;
+	unsigned char op;
+
+	if (*len >= NUMCODE_MAX - 1)
+		return -1;
+	switch (n->info & OPCLSMASK) {
+	case OC_VAR:
+		if (n->r.n)
+			return -1; /* array element */
+		code[*len].op = NC_VAR;
+		code[(*len)++].u.v = n->l.v;
+		return 1;
+	case OC_FNARG:
+		if (n->r.n)
+			return -1;
+		code[*len].op = NC_FNARG;
+		code[(*len)++].u.aidx = n->l.aidx;
+		return 1;
+	case OC_FIELD:
+		d1 = gen_numcode(n->r.n, code, len);
+		op = NC_FIELD;
+		break;
+	case OC_UNARY:
+		op = n->info & OPNMASK;
+		if (op != '-' && op != '+')
+			return -1;
+		d1 = gen_numcode(n->r.n, code, len);
+		if (op == '+')
+			return d1;
+		op = NC_NEG;
+		break;
+	case OC_BINARY:
+		switch (n->info & OPNMASK) {
+		case '+': op = NC_ADD; break;
+		case '-': op = NC_SUB; break;
+		case '*': op = NC_MUL; break;
+		case '/': op = NC_DIV; break;
+		case '%': op = NC_MOD; break;
+		case '&': op = NC_POW; break;
+		default: return -1;
+		}
+		d1 = gen_numcode(n->l.n, code, len);
+		if (d1 < 0)
+			return -1;
+		d2 = gen_numcode(n->r.n, code, len);
+		if (d2 < 0)
+			return -1;
+		if (d1 < d2 + 1)
+			d1 = d2 + 1;
+		break;
+	default:
+		return -1;
+	}
+	if (d1 < 0 || *len >= NUMCODE_MAX - 1)
+		return -1;
+	code[(*len)++].op = op;
+	return d1;
+}
+
+/* Turn OC_BINARY or OC_UNARY node into OC_NUMCODE if possible,
+ * else mark it so that we don't try again */
+static void compile_numcode(node *n)
+{
+	numcode code[NUMCODE_MAX];
+	int len = 0;
+	int depth;
+
+	depth = gen_numcode(n, code, &len);
+	if (depth < 0 || depth > NUMSTACK_MAX) {
+		n->info |= OF_NOCODE;
+		return;
+	}
+	code[len++].op = NC_END;
+	n->info = OC_NUMCODE;
+	n->l.code = xmemdup(code, len * sizeof(code[0]));
+}
+
+static double exec_numcode(const numcode *c)
+{
+	double stack[NUMSTACK_MAX];
+	double *sp = stack; /* next free slot */
+	var *v;
+	int i;
+
+	for (;; c++) {
+		switch (c->op) {
+		case NC_VAR:
+			v = c->u.v;
+			if (v == intvar[NF])
+				split_f0_upto(0);
+			*sp++ = getvar_i(v);
+			break;
+		case NC_FNARG:
+			*sp++ = getvar_i(&G.evaluate__fnargs[c->u.aidx]);
+			break;
+		case NC_FIELD:
+			/* same as OC_FIELD in evaluate() */
+			i = (int)sp[-1];
+			if (i == 0) {
+				v = intvar[F0];
+			} else {
+				split_f0_upto(i);
+				if (i > nfields)
+					fsrealloc(i);
+				v = &Fields[i - 1];
+			}
+			sp[-1] = getvar_i(v);
+			break;
+		case NC_NEG:
+			sp[-1] = -sp[-1];
+			break;
+		case NC_ADD:
+			sp--;
+			sp[-1] += sp[0];
+			break;
+		case NC_SUB:
+			sp--;
+			sp[-1] -= sp[0];
+			break;
+		case NC_MUL:
+			sp--;
+			sp[-1] *= sp[0];
+			break;
+		case NC_DIV:
+			sp--;
+			if (sp[0] == 0)
+				syntax_error(EMSG_DIV_BY_ZERO);
+			sp[-1] /= sp[0];
+			break;
+		case NC_MOD:
+			sp--;
+			if (sp[0] == 0)
+				syntax_error(EMSG_DIV_BY_ZERO);
+			sp[-1] -= (long long)(sp[-1] / sp[0]) * sp[0];
+			break;
+		case NC_POW:
+			sp--;
+			if (ENABLE_FEATURE_AWK_LIBM)
+				sp[-1] = pow(sp[-1], sp[0]);
+			else
+				syntax_error(EMSG_NO_MATH);
+			break;
+		default: /* NC_END */
+			return sp[-1];
+		}
+	}
+}
+
 /*
  * Evaluate node - the heart of the program. Supplied with subtree
  * and place where to store result. returns ptr to result.
@@ -2487,7 +2942,6 @@ static var *evaluate(node *op, var *res)
 #define fnargs (G.evaluate__fnargs)
 /* seed is initialized to 1 */
 #define seed   (G.evaluate__seed)
-#define sreg   (G.evaluate__sreg)
 
 	var *v1;
 
@@ -2496,6 +2950,19 @@ static var *evaluate(node *op, var *res)
 
 	debug_printf_eval("entered %s()\n", __func__);
 
+	/* Shortcut for the most common operands: scalar variables
+	 * and constants. Same as OC_VAR/OC_FNARG below */
+	if (!op->r.n) {
+		if ((op->info & OPCLSMASK) == OC_VAR && op->l.v != intvar[NF]) {
+			g_lineno = op->lineno;
+			return op->l.v;
+		}
+		if ((op->info & OPCLSMASK) == OC_FNARG) {
+			g_lineno = op->lineno;
+			return &fnargs[op->l.aidx];
+		}
+	}
+
 	v1 = nvalloc(2);
 
 	while (op) {
@@ -2513,6 +2980,12 @@ static var *evaluate(node *op, var *res)
 		node *op1;
 
 		opinfo = op->info;
+		if (!(opinfo & OF_NOCODE)
+		 && ((opinfo & OPCLSMASK) == OC_BINARY || (opinfo & OPCLSMASK) == OC_UNARY)
+		) {
+			compile_numcode(op);
+			opinfo = op->info;
+		}
 		opn = (opinfo & OPNMASK);
 		g_lineno = op->lineno;
 		op1 = op->l.n;
@@ -2672,7 +3145,7 @@ static var *evaluate(node *op, var *res)
 		case XC( OC_VAR ):
 			L.v = op->l.v;
 			if (L.v == intvar[NF])
-				split_f0();
+				split_f0_upto(0);
 			goto v_cont;
 
 		case XC( OC_FNARG ):
@@ -2694,10 +3167,8 @@ static var *evaluate(node *op, var *res)
 			op1 = op->r.n;
  re_cont:
 			{
-				regex_t *re = as_regex(op1, &sreg);
+				regex_t *re = as_regex(op1);
 				int i = regexec(re, L.s, 0, NULL, 0);
-				if (re == &sreg)
-					regfree(re);
 				setvar_i(res, (i == 0) ^ (opn == '!'));
 			}
 			break;
@@ -2910,6 +3381,10 @@ static var *evaluate(node *op, var *res)
 			res = exec_builtin(op, res);
 			break;
 
+		case XC( OC_NUMCODE ):
+			setvar_i(res, exec_numcode(op->l.code));
+			break;
+
 		case XC( OC_SPRINTF ):
 			setvar_p(res, awk_printf(op1));
 			break;
@@ -2949,7 +3424,7 @@ static var *evaluate(node *op, var *res)
 			if (i == 0) {
 				res = intvar[F0];
 			} else {
-				split_f0();
+				split_f0_upto(i);
 				if (i > nfields)
 					fsrealloc(i);
 				res = &Fields[i - 1];
@@ -3053,7 +3528,6 @@ static var *evaluate(node *op, var *res)
 	return res;
 #undef fnargs
 #undef seed
-#undef sreg
 }
 
 
@@ -3075,12 +3549,9 @@ static int awk_exit(int r)
 
 	/* waiting for children */
 	for (i = 0; i < fdhash->csize; i++) {
-		hi = fdhash->items[i];
-		while (hi) {
-			if (hi->data.rs.F && hi->data.rs.is_pipe)
-				pclose(hi->data.rs.F);
-			hi = hi->next;
-		}
+		hi = fdhash->items[i].item;
+		if (hi && hi->data.rs.F && hi->data.rs.is_pipe)
+			pclose(hi->data.rs.F);
 	}
 
 	exit(r);
@@ -22,7 +22,7 @@
  * resulting sed_cmd_t structures are appended to a linked list
  * (G.sed_cmd_head/G.sed_cmd_tail).
  *
- * process_files() does actual sedding, reading data lines from each input FILE*
+ * process_files() does actual sedding, reading data lines from each input file
  * (which could be stdin) and applying the sed command list (sed_cmd_head) to
  * each of the resulting lines.
  *
@@ -59,19 +59,33 @@
 //config:	help
 //config:	sed is used to perform text transformations on a file
 //config:	or input from a pipeline.
+//config:
+//config:config FEATURE_SED_PARALLEL
+//config:	bool "Enable parallel in-place editing (-P N)"
+//config:	default y
+//config:	depends on SED && PLATFORM_POSIX && !NOMMU
+//config:	select FEATURE_PROC_POOL
+//config:	help
+//config:	Enable -P N option: with -i, files are edited by N worker
+//config:	processes. Scripts which carry state from one file to the
+//config:	next (hold space, ranges, w files, q, r of a file being
+//config:	edited) are run serially.
 
 //applet:IF_SED(APPLET(sed, BB_DIR_BIN, BB_SUID_DROP))
 
 //kbuild:lib-$(CONFIG_SED) += sed.o
 
 //usage:#define sed_trivial_usage
-//usage:       "[-i[SFX]] [-nrE] [-f FILE]... [-e CMD]... [FILE]...\n"
-//usage:       "or: sed [-i[SFX]] [-nrE] CMD [FILE]..."
+//usage:       "[-i[SFX]] [-nrE] "IF_FEATURE_SED_PARALLEL("[-P N] ")"[-f FILE]... [-e CMD]... [FILE]...\n"
+//usage:       "or: sed [-i[SFX]] [-nrE] "IF_FEATURE_SED_PARALLEL("[-P N] ")"CMD [FILE]..."
 //usage:#define sed_full_usage "\n\n"
 //usage:       "	-e CMD	Add CMD to sed commands to be executed"
 //usage:     "\n	-f FILE	Add FILE contents to sed commands to be executed"
 //usage:     "\n	-i[SFX]	Edit files in-place (otherwise sends to stdout)"
 //usage:     "\n		Optionally back files up, appending SFX"
+//usage:	IF_FEATURE_SED_PARALLEL(
+//usage:     "\n	-P N	With -i, edit files using N processes"
+//usage:	)
 //usage:     "\n	-n	Suppress automatic printing of pattern space"
 //usage:     "\n	-r,-E	Use extended regex syntax"
 //usage:     IF_PLATFORM_MINGW32(
@@ -109,6 +123,7 @@ typedef struct sed_cmd_s {
 	regex_t *beg_match;     /* sed -e '/match/cmd' */
 	regex_t *end_match;     /* sed -e '/match/,/end_match/cmd' */
 	regex_t *sub_match;     /* For 's/sub_match/string/' */
+	char *sub_literal;      /* sub_match as a plain string, if it has no special chars */
 	int beg_line;           /* 'sed 1p'   0 == apply commands to all lines */
 	int beg_line_orig;      /* copy of the above, needed for -i */
 	int end_line;           /* 'sed 1,3p' 0 == one line only. -1 = last line ($). -2-N = +N */
@@ -141,12 +156,17 @@ struct globals {
 
 	FILE *nonstdout;
 	char *outname, *hold_space;
+	int hold_size;          /* allocated size of hold_space */
 	smallint exitcode;
 
 	/* list of input files */
 	int current_input_file, last_input_file;
 	char **input_file_list;
-	FILE *current_fp;
+	line_reader_t *current_lr;
+	/* unread part of the current input line, after a NUL */
+	char *rest_of_line;
+	size_t rest_len;
+	char rest_gets_char;
 
 	regmatch_t regmatch[10];
 	regex_t *previous_regex_ptr;
@@ -154,8 +174,9 @@ struct globals {
 	/* linked list of sed commands */
 	sed_cmd_t *sed_cmd_head, **sed_cmd_tail;
 
-	/* linked list of append lines */
-	llist_t *append_head;
+	/* 'a' and 'r' commands to output at the end of the cycle */
+	sed_cmd_t **append_cmd;
+	int append_cnt;
 
 	char *add_cmd_line;
 
@@ -173,12 +194,22 @@ struct globals {
 } while (0)
 
 
+static void close_input_file(void)
+{
+	int fd = G.current_lr->fd;
+
+	line_reader_free(G.current_lr);
+	if (fd != STDIN_FILENO)
+		close(fd);
+	G.current_lr = NULL;
+}
+
 #if ENABLE_FEATURE_CLEAN_UP
 static void sed_free_and_close_stuff(void)
 {
 	sed_cmd_t *sed_cmd = G.sed_cmd_head;
 
-	llist_free(G.append_head, free);
+	free(G.append_cmd);
 
 	while (sed_cmd) {
 		sed_cmd_t *sed_cmd_next = sed_cmd->next;
@@ -198,6 +229,7 @@ static void sed_free_and_close_stuff(void)
 			regfree(sed_cmd->sub_match);
 			free(sed_cmd->sub_match);
 		}
+		free(sed_cmd->sub_literal);
 		free(sed_cmd->string);
 		free(sed_cmd);
 		sed_cmd = sed_cmd_next;
@@ -205,8 +237,8 @@ static void sed_free_and_close_stuff(void)
 
 	free(G.hold_space);
 
-	if (G.current_fp)
-		fclose(G.current_fp);
+	if (G.current_lr)
+		close_input_file();
 }
 #else
 void sed_free_and_close_stuff(void);
@@ -480,6 +512,14 @@ static int parse_subst_cmd(sed_cmd_t *sed_cmd, const char *substr)
 		dbg("xregcomp('%s',%x)", match, cflags);
 		xregcomp(sed_cmd->sub_match, match, cflags);
 		dbg("regcomp ok");
+		/* Plain string? Then search for it with strstr().
+		 * (The regex is still needed for a later empty regex) */
+		if (!(cflags & REG_ICASE)
+		 && !strpbrk(match, (cflags & REG_EXTENDED) ? "\\.[*^$+?(){}|" : "\\.[*^$")
+		) {
+			sed_cmd->sub_literal = match;
+			match = NULL;
+		}
 	}
 	free(match);
 
@@ -731,14 +771,19 @@ static void add_cmd(const char *cmdstr)
 
 #define PIPE_GROW 64
 
-static void pipe_putc(char c)
+static void pipe_write(const char *str, int n)
 {
-	if (G.pipeline.idx == G.pipeline.len) {
-		G.pipeline.buf = xrealloc(G.pipeline.buf,
-				G.pipeline.len + PIPE_GROW);
-		G.pipeline.len += PIPE_GROW;
+	if (G.pipeline.len - G.pipeline.idx < n) {
+		G.pipeline.len = (G.pipeline.idx + n) * 2 + PIPE_GROW;
+		G.pipeline.buf = xrealloc(G.pipeline.buf, G.pipeline.len);
 	}
-	G.pipeline.buf[G.pipeline.idx++] = c;
+	memcpy(G.pipeline.buf + G.pipeline.idx, str, n);
+	G.pipeline.idx += n;
+}
+
+static void pipe_putc(char c)
+{
+	pipe_write(&c, 1);
 }
 
 static void do_subst_w_backrefs(char *line, char *replace)
@@ -747,6 +792,14 @@ static void do_subst_w_backrefs(char *line, char *replace)
 
 	/* go through the replacement string */
 	for (i = 0; replace[i]; i++) {
+		/* copy plain text up to the next special char in one go */
+		j = strcspn(replace + i, "\\&");
+		if (j) {
+			pipe_write(replace + i, j);
+			i += j;
+			if (!replace[i])
+				break;
+		}
 		/* if we find a backreference (\1, \2, etc.) print the backref'ed text */
 		if (replace[i] == '\\') {
 			unsigned backref = replace[++i] - '0';
@@ -754,8 +807,7 @@ static void do_subst_w_backrefs(char *line, char *replace)
 				/* print out the text held in G.regmatch[backref] */
 				if (G.regmatch[backref].rm_so != -1) {
 					j = G.regmatch[backref].rm_so;
-					while (j < G.regmatch[backref].rm_eo)
-						pipe_putc(line[j++]);
+					pipe_write(line + j, G.regmatch[backref].rm_eo - j);
 				}
 				continue;
 			}
@@ -767,18 +819,54 @@ static void do_subst_w_backrefs(char *line, char *replace)
 			continue;
 		}
 		/* if we find an unescaped '&' print out the whole matched text. */
-		if (replace[i] == '&') {
-			j = G.regmatch[0].rm_so;
-			while (j < G.regmatch[0].rm_eo)
-				pipe_putc(line[j++]);
-			continue;
-		}
-		/* Otherwise just output the character. */
-		pipe_putc(replace[i]);
+		j = G.regmatch[0].rm_so;
+		pipe_write(line + j, G.regmatch[0].rm_eo - j);
 	}
 }
 
-static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
+/* regexec() for s, or a plain string search if the pattern allows */
+static int subst_exec(sed_cmd_t *sed_cmd, regex_t *current_regex, char *line, int eflags)
+{
+	const char *match = sed_cmd->sub_literal;
+	char *p;
+	int i;
+
+	if (!match || current_regex != sed_cmd->sub_match)
+		return regexec(current_regex, line, 10, G.regmatch, eflags);
+
+	p = strstr(line, match);
+	if (!p)
+		return REG_NOMATCH;
+	G.regmatch[0].rm_so = p - line;
+	G.regmatch[0].rm_eo = G.regmatch[0].rm_so + strlen(match);
+	for (i = 1; i < 10; i++)
+		G.regmatch[i].rm_so = G.regmatch[i].rm_eo = -1;
+	return 0;
+}
+
+/* Make sure a reusable buffer can hold len bytes */
+static char *grow_buf(char **pbuf, int *psize, int len)
+{
+	if (*psize < len) {
+		*psize = len + len / 2 + 64;
+		*pbuf = xrealloc(*pbuf, *psize);
+	}
+	return *pbuf;
+}
+
+static void swap_buf(char **pbuf1, int *psize1, char **pbuf2, int *psize2)
+{
+	char *buf = *pbuf1;
+	int size = *psize1;
+
+	*pbuf1 = *pbuf2;
+	*psize1 = *psize2;
+	*pbuf2 = buf;
+	*psize2 = size;
+}
+
+/* Result replaces *line_p, the old buffer is kept for the next one */
+static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p, int *size_p)
 {
 	char *line = *line_p;
 	unsigned match_count = 0;
@@ -798,22 +886,19 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 
 	/* Find the first match */
 	dbg("matching '%s'", line);
-	if (REG_NOMATCH == regexec(current_regex, line, 10, G.regmatch, 0)) {
+	if (REG_NOMATCH == subst_exec(sed_cmd, current_regex, line, 0)) {
 		dbg("no match");
 		return 0;
 	}
 	dbg("match");
 
 	/* Initialize temporary output buffer. */
-	G.pipeline.buf = xmalloc(PIPE_GROW);
-	G.pipeline.len = PIPE_GROW;
 	G.pipeline.idx = 0;
 
 	/* Now loop through, substituting for matches */
 	do {
 		int start = G.regmatch[0].rm_so;
 		int end = G.regmatch[0].rm_eo;
-		int i;
 
 		match_count++;
 
@@ -822,8 +907,8 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		if (sed_cmd->which_match
 		 && (sed_cmd->which_match != match_count)
 		) {
-			for (i = 0; i < end; i++)
-				pipe_putc(*line++);
+			pipe_write(line, end);
+			line += end;
 			/* Null match? Print one more char */
 			if (start == end && *line)
 				pipe_putc(*line++);
@@ -831,8 +916,7 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		}
 
 		/* Print everything before the match */
-		for (i = 0; i < start; i++)
-			pipe_putc(line[i]);
+		pipe_write(line, start);
 
 		/* Then print the substitution string,
 		 * unless we just matched empty string after non-empty one.
@@ -880,18 +964,12 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		}
 
 //maybe (end ? REG_NOTBOL : 0) instead of unconditional REG_NOTBOL?
-	} while (regexec(current_regex, line, 10, G.regmatch, REG_NOTBOL) != REG_NOMATCH);
+	} while (subst_exec(sed_cmd, current_regex, line, REG_NOTBOL) != REG_NOMATCH);
 
 	/* Copy rest of string into output pipeline */
-	while (1) {
-		char c = *line++;
-		pipe_putc(c);
-		if (c == '\0')
-			break;
-	}
+	pipe_write(line, strlen(line) + 1);
 
-	free(*line_p);
-	*line_p = G.pipeline.buf;
+	swap_buf(line_p, size_p, &G.pipeline.buf, &G.pipeline.len);
 	return altered;
 }
 
@@ -911,9 +989,10 @@ static sed_cmd_t *branch_to(char *label)
 	bb_error_msg_and_die("can't find label for jump to '%s'", label);
 }
 
-static void append(char *s)
+static void append(sed_cmd_t *sed_cmd)
 {
-	llist_add_to_end(&G.append_head, s);
+	G.append_cmd = xrealloc_vector(G.append_cmd, 3, G.append_cnt);
+	G.append_cmd[G.append_cnt++] = sed_cmd;
 }
 
 /* Output line of text. */
@@ -970,32 +1049,49 @@ static void puts_maybe_newline(char *s, FILE *file, char *last_puts_char, char l
 
 static void flush_append(char *last_puts_char)
 {
-	char *data;
-
-	/* Output appended lines. */
-	while ((data = (char *)llist_pop(&G.append_head)) != NULL) {
-		/* Append command does not respect "nonterminated-ness"
-		 * of last line. Try this:
-		 * $ echo -n "woot" | sed -e '/woot/a woo' -
-		 * woot
-		 * woo
-		 * (both lines are terminated with \n)
-		 * Therefore we do not propagate "last_gets_char" here,
-		 * pass '\n' instead:
-		 */
-		puts_maybe_newline(data, G.nonstdout, last_puts_char, '\n');
-		free(data);
+	int i;
+
+	/* Output appended lines.
+	 * Append command does not respect "nonterminated-ness"
+	 * of last line. Try this:
+	 * $ echo -n "woot" | sed -e '/woot/a woo' -
+	 * woot
+	 * woo
+	 * (both lines are terminated with \n)
+	 * Therefore we do not propagate "last_gets_char" here,
+	 * pass '\n' instead:
+	 */
+	for (i = 0; i < G.append_cnt; i++) {
+		sed_cmd_t *sed_cmd = G.append_cmd[i];
+		FILE *rfile;
+		char *line;
+
+		if (sed_cmd->cmd == 'a') {
+			puts_maybe_newline(sed_cmd->string, G.nonstdout, last_puts_char, '\n');
+			continue;
+		}
+		/* 'r': like GNU sed, read the file only now */
+		rfile = fopen_for_read(sed_cmd->string);
+		if (rfile) {
+			while ((line = xmalloc_fgetline(rfile)) != NULL) {
+				puts_maybe_newline(line, G.nonstdout, last_puts_char, '\n');
+				free(line);
+			}
+			fclose(rfile);
+		}
 	}
+	G.append_cnt = 0;
 }
 
-/* Get next line of input from G.input_file_list, flushing append buffer and
- * noting if we ran out of files without a newline on the last line we read.
+/* Get next line of input from G.input_file_list into a reusable buffer,
+ * flushing append buffer and noting if we ran out of files without
+ * a newline on the last line we read.
  */
-static char *get_next_line(char *gets_char, char *last_puts_char)
+static char *get_next_line(char **pbuf, int *psize, char *gets_char, char *last_puts_char)
 {
-	char *temp = NULL;
-	int len;
-	char gc;
+	char *line = NULL;
+	size_t len;
+	char gc, c;
 
 	flush_append(last_puts_char);
 
@@ -1003,43 +1099,51 @@ static char *get_next_line(char *gets_char, char *last_puts_char)
 	 * doesn't end with either '\n' or '\0' */
 	gc = NO_EOL_CHAR;
 	for (; G.current_input_file <= G.last_input_file; G.current_input_file++) {
-		FILE *fp = G.current_fp;
-		if (!fp) {
+		line_reader_t *lr = G.current_lr;
+		if (!lr) {
 			const char *path = G.input_file_list[G.current_input_file];
-			fp = stdin;
+			int fd = STDIN_FILENO;
 			if (path != bb_msg_standard_input) {
-				fp = fopen_or_warn(path, "r");
-				if (!fp) {
+				fd = open(path, O_RDONLY);
+				if (fd < 0) {
+					bb_simple_perror_msg(path);
 					G.exitcode = EXIT_FAILURE;
 					continue;
 				}
 			}
-			G.current_fp = fp;
-		}
-		/* Read line up to a newline or NUL byte, inclusive,
-		 * return malloc'ed char[]. length of the chunk read
-		 * is stored in len. NULL if EOF/error */
-		temp = bb_get_chunk_from_file(fp, &len);
-		if (temp) {
-			/* len > 0 here, it's ok to do temp[len-1] */
-			char c = temp[len-1];
-			if (c == '\n' || c == '\0') {
-				temp[len-1] = '\0';
+			G.current_lr = lr = line_reader_fdopen(fd);
 #if ENABLE_PLATFORM_MINGW32
-				if (!G.keep_cr && c == '\n' && len > 1 && temp[len-2] == '\r') {
-					temp[len-2] = '\0';
-				}
+			lr->keep_cr = G.keep_cr;
 #endif
-				gc = c;
-				if (c == '\0') {
-					int ch = fgetc(fp);
-					if (ch != EOF)
-						ungetc(ch, fp);
-					else
-						gc = LAST_IS_NUL;
+		}
+		/* Lines end with a newline or a NUL byte. We read up to
+		 * a newline, and hand out NUL-separated pieces one by one */
+		line = G.rest_of_line;
+		len = G.rest_len;
+		c = G.rest_gets_char;
+		if (!line) {
+			line = line_reader_next(lr, '\n', &len);
+			c = lr->no_delim ? NO_EOL_CHAR : '\n';
+		}
+		if (line) {
+			char *nul = memchr(line, '\0', len);
+
+			gc = c;
+			G.rest_of_line = NULL;
+			if (nul) {
+				G.rest_of_line = nul + 1;
+				G.rest_len = len - (nul + 1 - line);
+				G.rest_gets_char = c;
+				len = nul - line;
+				gc = '\0';
+				/* had trailing '\0' and it was last char of file? */
+				if (G.rest_len == 0 && G.rest_gets_char == NO_EOL_CHAR) {
+					G.rest_of_line = NULL;
+					gc = LAST_IS_NUL;
 				}
 			}
-			/* else we put NO_EOL_CHAR into *gets_char */
+			line = memcpy(grow_buf(pbuf, psize, len + 1), line, len);
+			line[len] = '\0';
 			break;
 
 		/* NB: I had the idea of peeking next file(s) and returning
@@ -1051,11 +1155,10 @@ static char *get_next_line(char *gets_char, char *last_puts_char)
 		 * (note: *no* newline after "b bang"!) */
 		}
 		/* Close this file and advance to next one */
-		fclose_if_not_stdin(fp);
-		G.current_fp = NULL;
+		close_input_file();
 	}
 	*gets_char = gc;
-	return temp;
+	return line;
 }
 
 #define sed_puts(s, n) (puts_maybe_newline(s, G.nonstdout, &last_puts_char, n))
@@ -1072,7 +1175,10 @@ static int beg_match(sed_cmd_t *sed_cmd, const char *pattern_space)
 
 static void process_files(void)
 {
-	char *pattern_space, *next_line;
+	/* Pattern space and the line read in advance live in
+	 * buffers which are reused from line to line */
+	char *pattern_space = NULL, *next_buf = NULL, *next_line;
+	int ps_size = 0, next_size = 0;
 	int linenum = 0;
 	char last_puts_char = '\n';
 	char last_gets_char, next_gets_char;
@@ -1080,21 +1186,24 @@ static void process_files(void)
 	int substituted;
 
 	/* Prime the pump */
-	next_line = get_next_line(&next_gets_char, &last_puts_char);
+	next_line = get_next_line(&next_buf, &next_size, &next_gets_char, &last_puts_char);
 
 	/* Go through every line in each file */
  again:
 	substituted = 0;
 
 	/* Advance to next line.  Stop if out of lines. */
-	pattern_space = next_line;
-	if (!pattern_space)
+	if (!next_line) {
+		free(pattern_space);
+		free(next_buf);
 		return;
+	}
+	swap_buf(&pattern_space, &ps_size, &next_buf, &next_size);
 	last_gets_char = next_gets_char;
 
 	/* Read one line in advance so we can act on the last line,
 	 * the '$' address */
-	next_line = get_next_line(&next_gets_char, &last_puts_char);
+	next_line = get_next_line(&next_buf, &next_size, &next_gets_char, &last_puts_char);
 	linenum++;
 
 	/* For every line, go through all the commands */
@@ -1258,7 +1367,7 @@ static void process_files(void)
 
 		/* Substitute with regex */
 		case 's':
-			if (!do_subst_command(sed_cmd, &pattern_space))
+			if (!do_subst_command(sed_cmd, &pattern_space, &ps_size))
 				break;
 			dbg("do_subst_command succeeded:'%s'", pattern_space);
 			substituted |= 1;
@@ -1275,7 +1384,7 @@ static void process_files(void)
 
 		/* Append line to linked list to be printed later */
 		case 'a':
-			append(xstrdup(sed_cmd->string));
+			append(sed_cmd);
 			break;
 
 		/* Insert text before this line */
@@ -1292,19 +1401,8 @@ static void process_files(void)
 
 		/* Read file, append contents to output */
 		case 'r':
-		{
-			FILE *rfile;
-			rfile = fopen_for_read(sed_cmd->string);
-			if (rfile) {
-				char *line;
-				while ((line = xmalloc_fgetline(rfile))
-						!= NULL)
-					append(line);
-				fclose(rfile);
-			}
-
+			append(sed_cmd);
 			break;
-		}
 
 		/* Write pattern space to file. */
 		case 'w':
@@ -1321,10 +1419,9 @@ static void process_files(void)
 				/* If no next line, jump to end of script and exit. */
 				goto discard_line;
 			}
-			free(pattern_space);
-			pattern_space = next_line;
+			swap_buf(&pattern_space, &ps_size, &next_buf, &next_size);
 			last_gets_char = next_gets_char;
-			next_line = get_next_line(&next_gets_char, &last_puts_char);
+			next_line = get_next_line(&next_buf, &next_size, &next_gets_char, &last_puts_char);
 			substituted = 0;
 			linenum++;
 			break;
@@ -1332,7 +1429,6 @@ static void process_files(void)
 		/* Quit.  End of script, end of input. */
 		case 'q':
 			/* Exit the outer while loop */
-			free(next_line);
 			next_line = NULL;
 			goto discard_commands;
 
@@ -1354,11 +1450,11 @@ static void process_files(void)
 			}
 			/* Append next_line, read new next_line. */
 			len = strlen(pattern_space);
-			pattern_space = xrealloc(pattern_space, len + strlen(next_line) + 2);
+			grow_buf(&pattern_space, &ps_size, len + strlen(next_line) + 2);
 			pattern_space[len] = '\n';
 			strcpy(pattern_space + len+1, next_line);
 			last_gets_char = next_gets_char;
-			next_line = get_next_line(&next_gets_char, &last_puts_char);
+			next_line = get_next_line(&next_buf, &next_size, &next_gets_char, &last_puts_char);
 			linenum++;
 			break;
 		}
@@ -1393,61 +1489,52 @@ static void process_files(void)
 			break;
 		}
 		case 'g':	/* Replace pattern space with hold space */
-			free(pattern_space);
-			pattern_space = xstrdup(G.hold_space ? G.hold_space : "");
+		{
+			const char *hold = G.hold_space ? G.hold_space : "";
+
+			strcpy(grow_buf(&pattern_space, &ps_size, strlen(hold) + 1), hold);
 			break;
+		}
 		case 'G':	/* Append newline and hold space to pattern space */
 		{
-			int pattern_space_size = 2;
+			int pattern_space_size = strlen(pattern_space);
 			int hold_space_size = 0;
 
-			if (pattern_space)
-				pattern_space_size += strlen(pattern_space);
 			if (G.hold_space)
 				hold_space_size = strlen(G.hold_space);
-			pattern_space = xrealloc(pattern_space,
-					pattern_space_size + hold_space_size);
-			if (pattern_space_size == 2)
-				pattern_space[0] = 0;
-			strcat(pattern_space, "\n");
-			if (G.hold_space)
-				strcat(pattern_space, G.hold_space);
+			grow_buf(&pattern_space, &ps_size,
+					pattern_space_size + hold_space_size + 2);
+			pattern_space[pattern_space_size] = '\n';
+			strcpy(pattern_space + pattern_space_size + 1,
+					G.hold_space ? G.hold_space : "");
 			last_gets_char = '\n';
 
 			break;
 		}
 		case 'h':	/* Replace hold space with pattern space */
-			free(G.hold_space);
-			G.hold_space = xstrdup(pattern_space);
+			strcpy(grow_buf(&G.hold_space, &G.hold_size,
+					strlen(pattern_space) + 1), pattern_space);
 			break;
 		case 'H':	/* Append newline and pattern space to hold space */
 		{
-			int hold_space_size = 2;
-			int pattern_space_size = 0;
+			int hold_space_size = 0;
+			int pattern_space_size = strlen(pattern_space);
 
 			if (G.hold_space)
-				hold_space_size += strlen(G.hold_space);
-			if (pattern_space)
-				pattern_space_size = strlen(pattern_space);
-			G.hold_space = xrealloc(G.hold_space,
-					hold_space_size + pattern_space_size);
-
-			if (hold_space_size == 2)
-				*G.hold_space = 0;
-			strcat(G.hold_space, "\n");
-			if (pattern_space)
-				strcat(G.hold_space, pattern_space);
+				hold_space_size = strlen(G.hold_space);
+			grow_buf(&G.hold_space, &G.hold_size,
+					hold_space_size + pattern_space_size + 2);
+			G.hold_space[hold_space_size] = '\n';
+			strcpy(G.hold_space + hold_space_size + 1, pattern_space);
 
 			break;
 		}
 		case 'x': /* Exchange hold and pattern space */
-		{
-			char *tmp = pattern_space;
-			pattern_space = G.hold_space ? G.hold_space : xzalloc(1);
+			if (!G.hold_space)
+				*grow_buf(&G.hold_space, &G.hold_size, 1) = '\0';
+			swap_buf(&pattern_space, &ps_size, &G.hold_space, &G.hold_size);
 			last_gets_char = '\n';
-			G.hold_space = tmp;
 			break;
-		}
 		} /* switch */
 	} /* for each cmd */
 
@@ -1463,11 +1550,125 @@ static void process_files(void)
 	/* Delete and such jump here. */
  discard_line:
 	flush_append(&last_puts_char /*,last_gets_char*/);
-	free(pattern_space);
 
 	goto again;
 }
 
+/* Edit G.input_file_list[G.current_input_file], which is also
+ * G.last_input_file, in place */
+static void edit_in_place(const char *fname, const char *suffix)
+{
+	struct stat statbuf;
+	int nonstdoutfd;
+	sed_cmd_t *sed_cmd;
+
+	if (stat(fname, &statbuf) != 0) {
+		bb_simple_perror_msg(fname);
+		G.exitcode = EXIT_FAILURE;
+		G.current_input_file++;
+		return;
+	}
+	G.outname = xasprintf("%sXXXXXX", fname);
+	nonstdoutfd = xmkstemp(G.outname);
+	G.nonstdout = xfdopen_for_write(nonstdoutfd);
+	/* Set permissions/owner of output file */
+	/* chmod'ing AFTER chown would preserve suid/sgid bits,
+	 * but GNU sed 4.2.1 does not preserve them either */
+	fchmod(nonstdoutfd, statbuf.st_mode);
+	fchown(nonstdoutfd, statbuf.st_uid, statbuf.st_gid);
+
+	process_files();
+	fclose(G.nonstdout);
+	G.nonstdout = stdout;
+
+	if (suffix) {
+		char *backupname = xasprintf("%s%s", fname, suffix);
+		xrename(fname, backupname);
+		free(backupname);
+	}
+	/* else unlink(fname); - rename below does this */
+	xrename(G.outname, fname); //TODO: rollback backup on error?
+	free(G.outname);
+	G.outname = NULL;
+
+	/* Fix disabled range matches and mangled ",+N" ranges */
+	for (sed_cmd = G.sed_cmd_head; sed_cmd; sed_cmd = sed_cmd->next) {
+		sed_cmd->beg_line = sed_cmd->beg_line_orig;
+		sed_cmd->end_line = sed_cmd->end_line_orig;
+	}
+}
+
+#if ENABLE_FEATURE_SED_PARALLEL
+/* Is it one of the files to be edited? */
+static int is_input_file(const char *fname)
+{
+	struct stat st, ist;
+	int i;
+
+	if (stat(fname, &st) != 0)
+		return 0;
+	for (i = G.current_input_file; G.input_file_list[i]; i++) {
+		if (stat(G.input_file_list[i], &ist) == 0
+		 && ist.st_dev == st.st_dev && ist.st_ino == st.st_ino
+		) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Can files be edited independently, each starting with
+ * a fresh state? Not if hold space, ranges, w files or q
+ * carry something over from one file to the next.
+ * Neither if r reads a file being edited: serial run sees it
+ * edited or not depending on the order, workers - at random */
+static int script_is_per_file(void)
+{
+	sed_cmd_t *sed_cmd;
+
+	for (sed_cmd = G.sed_cmd_head; sed_cmd; sed_cmd = sed_cmd->next) {
+		if (sed_cmd->end_match || sed_cmd->end_line_orig
+		 || sed_cmd->sw_file || strchr("hHxgGq", sed_cmd->cmd)
+		 || (sed_cmd->cmd == 'r' && is_input_file(sed_cmd->string))
+		) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Files are handed to workers of a pool in batches. The pool
+ * collects workers' error messages and copies them to stderr in
+ * the order batches were started, so they come out as in a serial run */
+#define SED_BATCH 32
+static void edit_in_place_parallel(int nworkers, const char *suffix)
+{
+	proc_pool_t *pool = proc_pool_new(nworkers);
+	int next = G.current_input_file;
+
+	pool->outfd = STDERR_FILENO;
+	while (G.input_file_list[next]) {
+		int i;
+
+		if (proc_pool_fork(pool)) {
+			for (i = 0; i < SED_BATCH && G.input_file_list[next]; i++, next++) {
+				G.current_input_file = G.last_input_file = next;
+				edit_in_place(G.input_file_list[next], suffix);
+			}
+			exit(G.exitcode);
+		}
+		for (i = 0; i < SED_BATCH && G.input_file_list[next]; i++)
+			next++;
+	}
+	proc_pool_wait(pool);
+	if (!G.exitcode)
+		G.exitcode = pool->exitcode;
+	/* Nothing is left for the final process_files() */
+	G.current_input_file = next;
+	G.last_input_file = next - 1;
+}
+#endif
+
 /* It is possible to have a command line argument with embedded
  * newlines.  This counts as multiple command lines.
  * However, newline can be escaped: 's/e/z\<newline>z/'
@@ -1495,6 +1696,7 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 	unsigned opt;
 	llist_t *opt_e, *opt_f;
 	char *opt_i;
+	IF_FEATURE_SED_PARALLEL(int nworkers = 0;)
 
 #if ENABLE_LONG_OPTS
 	static const char sed_longopts[] ALIGN1 =
@@ -1534,9 +1736,11 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 	opt = getopt32long(argv, "^"
 			"i::rEne:*f:*"
 			IF_PLATFORM_MINGW32("b")
+			IF_FEATURE_SED_PARALLEL("P:+")
 			"\0" "nn"/*count -n*/,
 			sed_longopts,
 			&opt_i, &opt_e, &opt_f,
+			IF_FEATURE_SED_PARALLEL(&nworkers,)
 			&G.be_quiet); /* counter for -n */
 	//argc -= optind;
 	argv += optind;
@@ -1589,10 +1793,6 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 		goto start;
 
 		for (; *argv; argv++) {
-			struct stat statbuf;
-			int nonstdoutfd;
-			sed_cmd_t *sed_cmd;
-
 			G.last_input_file++;
  start:
 			if (!(opt & OPT_in_place)) {
@@ -1604,41 +1804,13 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 			}
 
 			/* -i: process each FILE separately: */
-
-			if (stat(*argv, &statbuf) != 0) {
-				bb_simple_perror_msg(*argv);
-				G.exitcode = EXIT_FAILURE;
-				G.current_input_file++;
-				continue;
-			}
-			G.outname = xasprintf("%sXXXXXX", *argv);
-			nonstdoutfd = xmkstemp(G.outname);
-			G.nonstdout = xfdopen_for_write(nonstdoutfd);
-			/* Set permissions/owner of output file */
-			/* chmod'ing AFTER chown would preserve suid/sgid bits,
-			 * but GNU sed 4.2.1 does not preserve them either */
-			fchmod(nonstdoutfd, statbuf.st_mode);
-			fchown(nonstdoutfd, statbuf.st_uid, statbuf.st_gid);
-
-			process_files();
-			fclose(G.nonstdout);
-			G.nonstdout = stdout;
-
-			if (opt_i) {
-				char *backupname = xasprintf("%s%s", *argv, opt_i);
-				xrename(*argv, backupname);
-				free(backupname);
-			}
-			/* else unlink(*argv); - rename below does this */
-			xrename(G.outname, *argv); //TODO: rollback backup on error?
-			free(G.outname);
-			G.outname = NULL;
-
-			/* Fix disabled range matches and mangled ",+N" ranges */
-			for (sed_cmd = G.sed_cmd_head; sed_cmd; sed_cmd = sed_cmd->next) {
-				sed_cmd->beg_line = sed_cmd->beg_line_orig;
-				sed_cmd->end_line = sed_cmd->end_line_orig;
+#if ENABLE_FEATURE_SED_PARALLEL
+			if (nworkers > 1 && script_is_per_file()) {
+				edit_in_place_parallel(nworkers, opt_i);
+				break;
 			}
+#endif
+			edit_in_place(*argv, opt_i);
 		}
 		/* Here, to handle "sed 'cmds' nonexistent_file" case we did:
 		 * if (G.current_input_file[G.current_input_file] == NULL)
@@ -218,19 +218,31 @@
 //config:	depends on FIND
 //config:	help
 //config:	Support the 'find -links' option for matching number of links.
+//config:
+//config:config FEATURE_FIND_PARALLEL
+//config:	bool "Enable parallel traversal (-j N)"
+//config:	default y
+//config:	depends on FIND && PLATFORM_POSIX && !NOMMU
+//config:	select FEATURE_PROC_POOL
+//config:	help
+//config:	Enable -j N option: subdirectories of each PATH are walked
+//config:	by N worker processes. Output is the same as without -j.
 
 //applet:IF_FIND(APPLET_NOEXEC(find, find, BB_DIR_USR_BIN, BB_SUID_DROP, find))
 
 //kbuild:lib-$(CONFIG_FIND) += find.o
 
 //usage:#define find_trivial_usage
-//usage:       "[-HL] [PATH]... [OPTIONS] [ACTIONS]"
+//usage:       "[-HL] "IF_FEATURE_FIND_PARALLEL("[-j N] ")"[PATH]... [OPTIONS] [ACTIONS]"
 //usage:#define find_full_usage "\n\n"
 //usage:       "Search for files and perform actions on them.\n"
 //usage:       "First failed action stops processing of current file.\n"
 //usage:       "Defaults: PATH is current directory, action is '-print'\n"
 //usage:     "\n	-L,-follow	Follow symlinks"
 //usage:     "\n	-H		...on command line only"
+//usage:	IF_FEATURE_FIND_PARALLEL(
+//usage:     "\n	-j N		Walk subdirectories of PATH using N processes"
+//usage:	)
 //usage:	IF_FEATURE_FIND_XDEV(
 //usage:     "\n	-xdev		Don't descend directories on other filesystems"
 //usage:	)
@@ -404,6 +416,10 @@ struct globals {
 	smallint xdev_on;
 	recurse_flags_t recurse_flags;
 	IF_FEATURE_FIND_EXEC_PLUS(unsigned max_argv_len;)
+#if ENABLE_FEATURE_FIND_PARALLEL
+	smallint parallel;
+	IF_FEATURE_FIND_EXEC_PLUS(smallint exec_plus_status;)
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -414,7 +430,7 @@ struct globals {
 	IF_FEATURE_FIND_MAXDEPTH(G.minmaxdepth[1] = INT_MAX;) \
 	IF_FEATURE_FIND_EXEC_PLUS(G.max_argv_len = bb_arg_max() - 2048;) \
 	G.need_print = 1; \
-	G.recurse_flags = ACTION_RECURSE; \
+	G.recurse_flags = ACTION_RECURSE | ACTION_NOSTAT; \
 } while (0)
 
 /* Return values of ACTFs ('action functions') are a bit mask:
@@ -855,6 +871,12 @@ static int FAST_FUNC fileAction(const char *fileName,
 	/* Had no explicit -print[0] or -exec? then print */
 	if ((r & TRUE) && G.need_print)
 		puts(fileName);
+#if ENABLE_FEATURE_FIND_PARALLEL && ENABLE_FEATURE_FIND_EXEC_PLUS
+	/* Workers are about to be forked: they must not
+	 * inherit (and run again) pending -exec {} + list */
+	if (depth == 0 && G.parallel)
+		G.exec_plus_status |= flush_exec_plus();
+#endif
 
 #if ENABLE_FEATURE_FIND_MAXDEPTH
 	if (S_ISDIR(statbuf->st_mode)) {
@@ -1053,6 +1075,9 @@ static action*** parse_params(char **argv)
 	}
 #define ALLOC_ACTION(name) (action_##name*)alloc_action(sizeof(action_##name), (action_fp) func_##name)
 #endif
+/* Tests which look at more than the file type: the walker can't
+ * take the type from readdir's d_type and skip stat() */
+#define ALLOC_STAT_ACTION(name) (G.recurse_flags &= ~ACTION_NOSTAT, ALLOC_ACTION(name))
 
 	cur_group = 0;
 	cur_action = 0;
@@ -1271,7 +1296,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_perm) {
 			action_perm *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(perm);
+			ap = ALLOC_STAT_ACTION(perm);
 			ap->perm_char = arg1[0];
 			arg1 = (arg1[0] == '/' ? arg1+1 : plus_minus_num(arg1));
 			/*ap->perm_mask = 0; - ALLOC_ACTION did it */
@@ -1284,7 +1309,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_mtime) {
 			action_mtime *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(mtime);
+			ap = ALLOC_STAT_ACTION(mtime);
 			ap->mtime_char = arg1[0];
 			ap->mtime_days = xatoul(plus_minus_num(arg1));
 		}
@@ -1293,7 +1318,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_mmin) {
 			action_mmin *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(mmin);
+			ap = ALLOC_STAT_ACTION(mmin);
 			ap->mmin_char = arg1[0];
 			ap->mmin_mins = xatoul(plus_minus_num(arg1));
 		}
@@ -1303,7 +1328,7 @@ static action*** parse_params(char **argv)
 			struct stat stat_newer;
 			action_newer *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(newer);
+			ap = ALLOC_STAT_ACTION(newer);
 			xstat(arg1, &stat_newer);
 			ap->newer_mtime = stat_newer.st_mtime;
 		}
@@ -1312,7 +1337,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_inum) {
 			action_inum *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(inum);
+			ap = ALLOC_STAT_ACTION(inum);
 			ap->inode_num = xatoul(arg1);
 		}
 #endif
@@ -1320,7 +1345,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_user) {
 			action_user *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(user);
+			ap = ALLOC_STAT_ACTION(user);
 			ap->uid = bb_strtou(arg1, NULL, 10);
 			if (errno)
 				ap->uid = xuname2uid(arg1);
@@ -1330,7 +1355,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_group) {
 			action_group *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(group);
+			ap = ALLOC_STAT_ACTION(group);
 			ap->gid = bb_strtou(arg1, NULL, 10);
 			if (errno)
 				ap->gid = xgroup2gid(arg1);
@@ -1359,7 +1384,7 @@ static action*** parse_params(char **argv)
 			};
 			action_size *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(size);
+			ap = ALLOC_STAT_ACTION(size);
 			ap->size_char = arg1[0];
 			ap->size = XATOU_SFX(plus_minus_num(arg1), find_suffixes);
 		}
@@ -1379,7 +1404,7 @@ static action*** parse_params(char **argv)
 		else if (parm == PARM_links) {
 			action_links *ap;
 			dbg("%d", __LINE__);
-			ap = ALLOC_ACTION(links);
+			ap = ALLOC_STAT_ACTION(links);
 			ap->links_char = arg1[0];
 			ap->links_count = xatoul(plus_minus_num(arg1));
 		}
@@ -1392,17 +1417,29 @@ static action*** parse_params(char **argv)
 	}
 	dbg("exiting %s", __func__);
 	return appp;
+#undef ALLOC_STAT_ACTION
 #undef ALLOC_ACTION
 #undef appp
 #undef cur_action
 #undef invert_flag
 }
 
+#if ENABLE_FEATURE_FIND_PARALLEL
+/* A worker runs what it has collected for -exec {} + */
+static int FAST_FUNC find_worker_exit(int exitcode)
+{
+	IF_FEATURE_FIND_EXEC_PLUS(exitcode |= flush_exec_plus();)
+	return exitcode;
+}
+#endif
+
 int find_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int find_main(int argc UNUSED_PARAM, char **argv)
 {
 	int i, firstopt, status = EXIT_SUCCESS;
 	char **past_HLP, *saved;
+	IF_FEATURE_FIND_PARALLEL(unsigned nworkers = 0;)
+	IF_FEATURE_FIND_PARALLEL(proc_pool_t *pool = NULL;)
 
 	INIT_G();
 
@@ -1419,12 +1456,22 @@ int find_main(int argc UNUSED_PARAM, char **argv)
 			break;
 		if (!saved[1])
 			break; /* it is "-" */
-		if ((saved+1)[strspn(saved+1, "HLP")] != '\0')
+		if ((saved+1)[strspn(saved+1, "HLP")] != '\0') {
+#if ENABLE_FEATURE_FIND_PARALLEL
+			/* -j N or -jN */
+			if (saved[1] == 'j') {
+				if (!saved[2] && past_HLP[1])
+					past_HLP++;
+				continue;
+			}
+#endif
 			break;
+		}
 	}
 	*past_HLP = NULL;
 	/* "+": stop on first non-option */
-	i = getopt32(argv, "+HLP");
+	i = getopt32(argv, "+HLP" IF_FEATURE_FIND_PARALLEL("j:+")
+			IF_FEATURE_FIND_PARALLEL(, &nworkers));
 	if (i & (1<<0))
 		G.recurse_flags |= ACTION_FOLLOWLINKS_L0 | ACTION_DANGLING_OK;
 	if (i & (1<<1))
@@ -1453,6 +1500,8 @@ int find_main(int argc UNUSED_PARAM, char **argv)
 	if (G.xdev_on) {
 		struct stat stbuf;
 
+		G.recurse_flags &= ~ACTION_NOSTAT;
+
 		G.xdev_count = firstopt;
 		G.xdev_dev = xzalloc(G.xdev_count * sizeof(G.xdev_dev[0]));
 		for (i = 0; argv[i]; i++) {
@@ -1467,7 +1516,24 @@ int find_main(int argc UNUSED_PARAM, char **argv)
 	}
 #endif
 
+#if ENABLE_FEATURE_FIND_PARALLEL
+	if (nworkers > 1) {
+		pool = proc_pool_new(nworkers);
+		G.parallel = 1;
+	}
+#endif
 	for (i = 0; argv[i]; i++) {
+#if ENABLE_FEATURE_FIND_PARALLEL
+		if (pool) {
+			if (!recursive_action_parallel(argv[i],
+					G.recurse_flags, fileAction, fileAction, NULL, 0,
+					pool, find_worker_exit)
+			) {
+				status |= EXIT_FAILURE;
+			}
+			continue;
+		}
+#endif
 		if (!recursive_action(argv[i],
 				G.recurse_flags,/* flags */
 				fileAction,     /* file action */
@@ -1480,5 +1546,8 @@ int find_main(int argc UNUSED_PARAM, char **argv)
 	}
 
 	IF_FEATURE_FIND_EXEC_PLUS(status |= flush_exec_plus();)
+#if ENABLE_FEATURE_FIND_PARALLEL
+	IF_FEATURE_FIND_EXEC_PLUS(status |= G.exec_plus_status;)
+#endif
 	return status;
 }
@@ -43,6 +43,16 @@
 //config:	Print the specified number of leading (-B) and/or trailing (-A)
 //config:	context surrounding our matching lines.
 //config:	Print the specified number of context lines (-C).
+//config:
+//config:config FEATURE_GREP_PARALLEL
+//config:	bool "Enable parallel recursive search (-j N)"
+//config:	default y
+//config:	depends on (GREP || EGREP || FGREP) && PLATFORM_POSIX && !NOMMU
+//config:	select FEATURE_PROC_POOL
+//config:	help
+//config:	Enable -j N option: with -r, files are searched by N worker
+//config:	processes while the directory tree is being walked.
+//config:	Output is grouped and ordered exactly as without -j.
 
 //applet:IF_GREP(APPLET(grep, BB_DIR_BIN, BB_SUID_DROP))
 //                APPLET_ODDNAME:name   main  location    suid_type     help
@@ -64,6 +74,7 @@
 //usage:	IF_EXTRA_COMPAT("z")
 //usage:       "] [-m N] "
 //usage:	IF_FEATURE_GREP_CONTEXT("[-A/B/C N] ")
+//usage:	IF_FEATURE_GREP_PARALLEL("[-j N] ")
 //usage:       "PATTERN/-e PATTERN.../-f FILE [FILE]..."
 //usage:#define grep_full_usage "\n\n"
 //usage:       "Search for PATTERN in FILEs (or stdin)\n"
@@ -78,6 +89,9 @@
 //usage:     "\n	-v	Select non-matching lines"
 //usage:     "\n	-s	Suppress open and read errors"
 //usage:     "\n	-r	Recurse"
+//usage:	IF_FEATURE_GREP_PARALLEL(
+//usage:     "\n	-j N	Search files using N processes (with -r)"
+//usage:	)
 //usage:     "\n	-i	Ignore case"
 //usage:     "\n	-w	Match whole words only"
 //usage:     "\n	-x	Match whole lines only"
@@ -112,7 +126,8 @@
 	IF_FEATURE_GREP_CONTEXT("A:+B:+C:+") \
 	"E" \
 	IF_EXTRA_COMPAT("z") \
-	"aI"
+	"aI" \
+	IF_FEATURE_GREP_PARALLEL("j:+")
 /* ignored: -a "assume all files to be text" */
 /* ignored: -I "assume binary files have no matches" */
 enum {
@@ -139,6 +154,9 @@ enum {
 	IF_FEATURE_GREP_CONTEXT(    OPTBIT_C ,) /* -C NUM: -A and -B combined */
 	OPTBIT_E, /* extended regexp */
 	IF_EXTRA_COMPAT(            OPTBIT_z ,) /* input is NUL terminated */
+	OPTBIT_a, /* ignored */
+	OPTBIT_I, /* ignored */
+	IF_FEATURE_GREP_PARALLEL(   OPTBIT_j ,) /* -j NUM: worker processes */
 	OPT_l = 1 << OPTBIT_l,
 	OPT_n = 1 << OPTBIT_n,
 	OPT_q = 1 << OPTBIT_q,
@@ -162,6 +180,7 @@ enum {
 	OPT_C = IF_FEATURE_GREP_CONTEXT(    (1 << OPTBIT_C)) + 0,
 	OPT_E = 1 << OPTBIT_E,
 	OPT_z = IF_EXTRA_COMPAT(            (1 << OPTBIT_z)) + 0,
+	OPT_j = IF_FEATURE_GREP_PARALLEL(   (1 << OPTBIT_j)) + 0,
 };
 
 #define PRINT_FILES_WITH_MATCHES    (option_mask32 & OPT_l)
@@ -188,12 +207,21 @@ struct globals {
 	int lines_before;
 	int lines_after;
 	char **before_buf;
-	IF_EXTRA_COMPAT(size_t *before_buf_size;)
+	size_t *before_buf_size;
 	int last_line_printed;
 #endif
 	/* globals used internally */
 	llist_t *pattern_head;   /* growable list of patterns to match */
+	struct ac_trie *ac;      /* -F with several patterns: all of them at once */
+	const char *needle;      /* string which every matching line contains */
+	smalluint skip_lines;    /* look for ac/needle match before splitting lines */
 	const char *cur_file;    /* the current file we are reading */
+#if ENABLE_FEATURE_GREP_PARALLEL
+	int nworkers;
+	proc_pool_t *pool;       /* -r -j N: files are searched by workers */
+	unsigned nfiles;         /* in the batch being collected */
+	char **files;
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -225,7 +253,11 @@ struct globals {
 #define before_buf_size   (G.before_buf_size     )
 #define last_line_printed (G.last_line_printed   )
 #define pattern_head      (G.pattern_head        )
+#define ac                (G.ac                  )
+#define needle            (G.needle              )
+#define skip_lines        (G.skip_lines          )
 #define cur_file          (G.cur_file            )
+#define pool              (G.pool                )
 
 
 typedef struct grep_list_data_t {
@@ -241,12 +273,19 @@ typedef struct grep_list_data_t {
 #define ALLOCATED 1
 #define COMPILED 2
 	int flg_mem_allocated_compiled;
+	char *required; /* literal which every match contains, or NULL */
 } grep_list_data_t;
 
-#if !ENABLE_EXTRA_COMPAT
-#define print_line(line, line_len, linenum, decoration) \
-	print_line(line, linenum, decoration)
+/* Lines are matched as (pointer, length) and may contain NULs.
+ * regexec() can do that only with REG_STARTEND. Without it,
+ * a NUL byte ends the line, as in xmalloc_fgetline() */
+#if ENABLE_EXTRA_COMPAT || defined(REG_STARTEND)
+# define next_line(lr, delim, lenp) line_reader_next(lr, delim, lenp)
+#else
+# define next_line(lr, delim, lenp) line_reader_next_str(lr, delim, lenp)
+# define REG_STARTEND 0
 #endif
+
 static void print_line(const char *line, size_t line_len, int linenum, char decoration)
 {
 #if ENABLE_FEATURE_GREP_CONTEXT
@@ -270,47 +309,358 @@ static void print_line(const char *line, size_t line_len, int linenum, char deco
 		printf("%i%c", linenum, decoration);
 	/* Emulate weird GNU grep behavior with -ov */
 	if ((option_mask32 & (OPT_v|OPT_o)) != (OPT_v|OPT_o)) {
-#if !ENABLE_EXTRA_COMPAT
-		puts(line);
-#else
 		fwrite(line, 1, line_len, stdout);
 		putchar(NUL_DELIMITED ? '\0' : '\n');
-#endif
 	}
 }
 
-#if ENABLE_EXTRA_COMPAT
-/* Unlike getline, this one removes trailing '\n' */
-static ssize_t FAST_FUNC bb_getline(char **line_ptr, size_t *line_alloc_len, FILE *file)
+/* Find the longest string which every match of the regex must contain.
+ * Lines without it can be rejected without running the regex engine.
+ * Anything not understood ends the current literal run; alternation
+ * means there is no required literal at all.
+ */
+/* Is there *, ? or an interval next, making the preceding atom optional? */
+static int quantifier_at(const char *p, int ere)
 {
-	ssize_t res_sz;
-	char *line;
-	int delim = (NUL_DELIMITED ? '\0' : '\n');
+	if (*p == '*')
+		return 1;
+	if (ere)
+		return *p == '?' || *p == '{';
+	return p[0] == '\\' && (p[1] == '?' || p[1] == '{');
+}
+
+static char *required_literal(const char *p, int ere)
+{
+	char *run = xmalloc(strlen(p) + 1);
+	char *best = NULL;
+	unsigned len = 0, best_len = 0;
+	int depth = 0;
+
+	for (;;) {
+		unsigned char c = *p++;
+		int lit = -1;
+		smallint optional = 0; /* previous atom may be absent */
+
+		if (c == '\\') {
+			c = *p++;
+			if (c == '\0' || c == '|' || c == '\n')
+				goto give_up;
+			if (strchr(".[]*^$\\/", c) || (ere && strchr("+?(){}", c)))
+				lit = c;
+			else if (!ere && c == '(')
+				depth++;
+			else if (!ere && c == ')')
+				depth--;
+			else if (!ere && c == '?')
+				optional = 1;
+			else if (!ere && c == '{')
+				goto interval;
+			else if (!ere && c == '+')
+				goto plus;
+			/* else: backreference, \w, \< etc */
+		} else if (c == '|' && ere) {
+			goto give_up;
+		} else if (c == '\n') {
+			goto give_up; /* GNU regex: newline is alternation */
+		} else if (c == '*' || (ere && c == '?')) {
+			optional = 1;
+		} else if (c == '{' && ere) {
+ interval:
+			/* {0,N} is possible, and "N,M" is not a literal */
+			p = strchr(p, '}');
+			if (!p)
+				goto give_up;
+			p++;
+			optional = 1;
+		} else if (c == '+' && ere) {
+ plus:
+			/* "a+*" is "(a+)*": "a" is not required then */
+			optional = quantifier_at(p, ere);
+		} else if (c == '(' && ere) {
+			depth++;
+		} else if (c == ')' && ere) {
+			depth--;
+		} else if (c == '[') {
+			/* Skip bracket expression: []...], [^]...], [[:alpha:]] */
+			if (*p == '^')
+				p++;
+			if (*p == ']')
+				p++;
+			while (*p != ']') {
+				if (*p == '\0')
+					goto give_up;
+				if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+					char *e = strchr(p + 2, p[1]);
+					while (e && e[1] != ']')
+						e = strchr(e + 1, p[1]);
+					if (!e)
+						goto give_up;
+					p = e + 1;
+				}
+				p++;
+			}
+			p++;
+		} else if (c != '\0' && c != '.' && c != '^' && c != '$'
+		 && c < 0x80 /* don't split multibyte chars */
+		) {
+			lit = c;
+		}
+
+		if (lit >= 0) {
+			if (depth == 0)
+				run[len++] = lit;
+			continue;
+		}
+		/* End of literal run */
+		if (optional && len)
+			len--;
+		if (len > best_len) {
+			free(best);
+			best = xstrndup(run, len);
+			best_len = len;
+		}
+		len = 0;
+		if (c == '\0')
+			break;
+	}
+	free(run);
+	return best;
+ give_up:
+	free(run);
+	free(best);
+	return NULL;
+}
+
+/* Aho-Corasick automaton: with many -F patterns, looking for each
+ * of them separately with strstr() is slow. Instead, a trie of all
+ * patterns with "failure" links lets us find all occurrences
+ * of all patterns in one pass over the line.
+ */
+typedef struct ac_node {
+	int child;      /* first child */
+	int sibling;    /* next child of our parent */
+	int fail;       /* node of the longest proper suffix */
+	int dict;       /* nearest node on the fail chain which ends a pattern */
+	int pat;        /* index of pattern ending here, or -1 */
+	unsigned char ch;
+} ac_node;
+
+typedef struct ac_trie {
+	ac_node *node;          /* node[0] is the root */
+	grep_list_data_t **gl;  /* pattern index -> pattern */
+	unsigned *len;          /* pattern index -> its length */
+	int root_next[256];     /* root has lots of children: direct lookup */
+	unsigned char fold[256];
+} ac_trie;
+
+static int ac_child(const ac_trie *t, int n, unsigned char c)
+{
+	if (n == 0)
+		return t->root_next[c];
+	for (n = t->node[n].child; n; n = t->node[n].sibling)
+		if (t->node[n].ch == c)
+			break;
+	return n;
+}
+
+static ac_trie *ac_build(void)
+{
+	ac_trie *t;
+	llist_t *cur;
+	int *queue;
+	int nnodes, npat, head, tail, i;
+
+	t = xzalloc(sizeof(*t));
+	for (i = 0; i < 256; i++)
+		t->fold[i] = (option_mask32 & OPT_i) ? tolower(i) : i;
+	t->node = xrealloc_vector(t->node, 8, 0);
+	t->node[0].pat = -1;
+	nnodes = 1;
+
+	/* Pattern index is its position in pattern_head:
+	 * -o prints the first matching pattern, as the strstr loop does */
+	npat = 0;
+	for (cur = pattern_head; cur; cur = cur->link, npat++) {
+		grep_list_data_t *gl = (grep_list_data_t *)cur->data;
+		const unsigned char *p = (const unsigned char *)gl->pattern;
+		int n = 0;
+
+		t->gl = xrealloc_vector(t->gl, 6, npat);
+		t->len = xrealloc_vector(t->len, 6, npat);
+		t->gl[npat] = gl;
+		t->len[npat] = strlen(gl->pattern);
+		for (; *p; p++) {
+			unsigned char c = t->fold[*p];
+			int next = ac_child(t, n, c);
+			if (!next) {
+				next = nnodes++;
+				t->node = xrealloc_vector(t->node, 8, next);
+				t->node[next].ch = c;
+				t->node[next].pat = -1;
+				if (n == 0) {
+					t->root_next[c] = next;
+				} else {
+					t->node[next].sibling = t->node[n].child;
+					t->node[n].child = next;
+				}
+			}
+			n = next;
+		}
+		if (t->node[n].pat < 0) /* else it's a duplicate */
+			t->node[n].pat = npat;
+	}
+
+	/* Breadth-first: fail links of shallower nodes are ready
+	 * when we need them. Root's children fail to root */
+	queue = xmalloc(nnodes * sizeof(queue[0]));
+	head = tail = 0;
+	for (i = 0; i < 256; i++)
+		if (t->root_next[i])
+			queue[tail++] = t->root_next[i];
+	while (head < tail) {
+		int u = queue[head++];
+		int v;
+		for (v = t->node[u].child; v; v = t->node[v].sibling) {
+			unsigned char c = t->node[v].ch;
+			int f = t->node[u].fail;
+			while (f && !ac_child(t, f, c))
+				f = t->node[f].fail;
+			f = ac_child(t, f, c);
+			t->node[v].fail = f;
+			t->node[v].dict = (t->node[f].pat >= 0) ? f : t->node[f].dict;
+			queue[tail++] = v;
+		}
+	}
+	free(queue);
+	return t;
+}
+
+static int ac_next(const ac_trie *t, int n, unsigned char c)
+{
+	int next;
+
+	while ((next = ac_child(t, n, c)) == 0 && n != 0)
+		n = t->node[n].fail;
+	return next;
+}
+
+/* Returns where the first occurrence of any pattern ends,
+ * or NULL. -w and -x are not checked */
+static char *ac_find(char *buf, size_t len, int delim)
+{
+	const ac_trie *t = ac;
+	size_t i;
+	int n = 0;
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = buf[i];
+		if (c == delim) {
+			n = 0;
+			continue;
+		}
+		n = ac_next(t, n, t->fold[c]);
+		if (t->node[n].pat >= 0 || t->node[n].dict)
+			return buf + i;
+	}
+	return NULL;
+}
+
+static int is_word_char(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Returns index of the first (in pattern_head order) pattern
+ * matching the line, or -1. Without -o, any match will do */
+static int ac_match(const char *line, size_t len)
+{
+	const ac_trie *t = ac;
+	size_t i;
+	int n = 0;
+	int best = -1;
+
+	for (i = 0; i < len; i++) {
+		int d;
+
+		n = ac_next(t, n, t->fold[(unsigned char)line[i]]);
+		/* Walk all patterns which end at line[i] */
+		d = (t->node[n].pat >= 0) ? n : t->node[n].dict;
+		for (; d; d = t->node[d].dict) {
+			int p = t->node[d].pat;
+			size_t start = i + 1 - t->len[p];
+
+			if (option_mask32 & OPT_x) {
+				if (start != 0 || i + 1 != len)
+					continue;
+			} else
+			if (option_mask32 & OPT_w) {
+				if (start != 0 && is_word_char(line[start - 1]))
+					continue;
+				if (i + 1 < len && is_word_char(line[i + 1]))
+					continue;
+			}
+			if (!(option_mask32 & OPT_o))
+				return p;
+			if (best < 0 || p < best)
+				best = p;
+		}
+	}
+	return best;
+}
+
+/* strcasestr() for a line which may contain NULs */
+static char *memcasemem(const char *hay, size_t len, const char *str)
+{
+	size_t n = strlen(str);
+
+	for (; len >= n; hay++, len--) {
+		if (strncasecmp(hay, str, n) == 0)
+			return (char*)hay;
+	}
+	return NULL;
+}
 
-	res_sz = getdelim(line_ptr, line_alloc_len, delim, file);
-	line = *line_ptr;
+/* Without -v and leading context, non-matching lines are never printed.
+ * Instead of matching them one by one, find the first possible match
+ * in the buffered input and skip all lines before it at once.
+ * Returns the number of skipped lines.
+ */
+static unsigned skip_to_candidate(line_reader_t *lr, int delim)
+{
+	char *start = lr->buf + lr->pos;
+	size_t len = lr->end - lr->pos;
+	char *p;
 
-	if (res_sz > 0) {
-		if (line[res_sz - 1] == delim)
-			line[--res_sz] = '\0';
+	p = ac ? ac_find(start, len, delim)
+		: memmem(start, len, needle, strlen(needle));
+	if (p) {
+		/* Back up to the start of its line */
+		p = memrchr(start, delim, p - start);
+	} else if (lr->eof) {
+		/* No matches till EOF. Line count is not needed anymore */
+		lr->pos = lr->end;
+		return 0;
 	} else {
-		free(line); /* uclibc allocates a buffer even on EOF. WTF? */
+		/* The last line may continue in the next block */
+		p = memrchr(start, delim, len);
 	}
-	return res_sz;
+	if (!p)
+		return 0;
+	p++;
+	lr->pos = p - lr->buf;
+	return bb_memcount(start, delim, p - start);
 }
-#endif
 
 static int grep_file(FILE *file)
 {
 	smalluint found;
 	int linenum = 0;
 	int nmatches = 0;
-#if !ENABLE_EXTRA_COMPAT
+	int delim = (NUL_DELIMITED ? '\0' : '\n');
+	line_reader_t *lr;
 	char *line;
-#else
-	char *line = NULL;
-	ssize_t line_len;
-	size_t line_alloc_len;
+	size_t line_len;
+#if ENABLE_EXTRA_COMPAT
 # define rm_so start[0]
 # define rm_eo end[0]
 #endif
@@ -322,42 +672,54 @@ static int grep_file(FILE *file)
 	enum { print_n_lines_after = 0 };
 #endif
 
-	while (
-#if !ENABLE_EXTRA_COMPAT
-		(line = xmalloc_fgetline(file)) != NULL
-#else
-		(line_len = bb_getline(&line, &line_alloc_len, file)) >= 0
-#endif
-	) {
+	lr = line_reader_fdopen(fileno(file));
+	for (;;) {
 		llist_t *pattern_ptr = pattern_head;
 		grep_list_data_t *gl = gl; /* for gcc */
 
+		if (skip_lines && !print_n_lines_after)
+			linenum += skip_to_candidate(lr, delim);
+		line = next_line(lr, delim, &line_len);
+		if (!line)
+			break;
 		linenum++;
 		found = 0;
+		if (ac) {
+			int p = ac_match(line, line_len);
+			if (p >= 0) {
+				gl = ac->gl[p];
+				found = 1;
+			}
+			pattern_ptr = NULL;
+		}
 		while (pattern_ptr) {
 			gl = (grep_list_data_t *)pattern_ptr->data;
 			if (FGREP_FLAG) {
 				char *match;
 				char *str = line;
+				char *end = line + line_len;
+				size_t plen = strlen(gl->pattern);
  opt_f_again:
 				match = ((option_mask32 & OPT_i)
-					? strcasestr(str, gl->pattern)
-					: strstr(str, gl->pattern)
+					? memcasemem(str, end - str, gl->pattern)
+					: memmem(str, end - str, gl->pattern, plen)
 					);
 				if (match) {
 					if (option_mask32 & OPT_x) {
 						if (match != str)
 							goto opt_f_not_found;
-						if (str[strlen(gl->pattern)] != '\0')
+						if (match + plen != end)
 							goto opt_f_not_found;
 					} else
 					if (option_mask32 & OPT_w) {
-						char c = (match != str) ? match[-1] : ' ';
+						char c = (match != line) ? match[-1] : ' ';
 						if (!isalnum(c) && c != '_') {
-							c = match[strlen(gl->pattern)];
-							if (!c || (!isalnum(c) && c != '_'))
+							c = (match + plen != end) ? match[plen] : ' ';
+							if (!isalnum(c) && c != '_')
 								goto opt_f_found;
 						}
+						if (match == end)
+							goto opt_f_not_found;
 						str = match + 1;
 						goto opt_f_again;
 					}
@@ -384,16 +746,27 @@ static int grep_file(FILE *file)
 						bb_error_msg_and_die("bad regex '%s'", gl->pattern);
 #endif
 				}
+				if (gl->required) {
+					/* Cheap check before running the regex engine */
+					if (!((option_mask32 & OPT_i)
+						? memcasemem(line, line_len, gl->required)
+						: memmem(line, line_len, gl->required, strlen(gl->required)))
+					) {
+						goto not_candidate;
+					}
+				}
 #if !ENABLE_EXTRA_COMPAT
-				gl->matched_range.rm_so = 0;
-				gl->matched_range.rm_eo = 0;
-				match_flg = 0;
+				match_flg = REG_STARTEND;
 #else
 				start_pos = 0;
 #endif
 				match_at = line;
  opt_w_again:
 //bb_error_msg("'%s' start_pos:%d line_len:%d", match_at, start_pos, line_len);
+#if !ENABLE_EXTRA_COMPAT
+				gl->matched_range.rm_so = 0;
+				gl->matched_range.rm_eo = line + line_len - match_at;
+#endif
 				if (
 #if !ENABLE_EXTRA_COMPAT
 					regexec(&gl->compiled_regex, match_at, 1, &gl->matched_range, match_flg) == 0
@@ -405,7 +778,7 @@ static int grep_file(FILE *file)
 				) {
 					if (option_mask32 & OPT_x) {
 						found = (gl->matched_range.rm_so == 0
-						         && match_at[gl->matched_range.rm_eo] == '\0');
+						         && match_at + gl->matched_range.rm_eo == line + line_len);
 					} else
 					if (!(option_mask32 & OPT_w)) {
 						found = 1;
@@ -415,7 +788,9 @@ static int grep_file(FILE *file)
 							c = match_at[gl->matched_range.rm_so - 1];
 						}
 						if (!isalnum(c) && c != '_') {
-							c = match_at[gl->matched_range.rm_eo];
+							c = ' ';
+							if (match_at + gl->matched_range.rm_eo < line + line_len)
+								c = match_at[gl->matched_range.rm_eo];
 						}
 						if (!isalnum(c) && c != '_') {
 							found = 1;
@@ -447,6 +822,7 @@ static int grep_file(FILE *file)
 			 * at first match */
 			if (found && !invert_search)
 				goto do_found;
+ not_candidate:
 			pattern_ptr = pattern_ptr->link;
 		} /* while (pattern_ptr) */
 
@@ -457,7 +833,7 @@ static int grep_file(FILE *file)
 
 			/* quiet/print (non)matching file names only? */
 			if (option_mask32 & (OPT_q|OPT_l|OPT_L)) {
-				free(line); /* we don't need line anymore */
+				line_reader_free(lr);
 				if (BE_QUIET) {
 					/* manpage says about -q:
 					 * "exit immediately with zero status
@@ -518,23 +894,23 @@ static int grep_file(FILE *file)
 						 * (unless -v: -Fov doesn't print anything at all) */
 						if (found)
 							print_line(gl->pattern, strlen(gl->pattern), linenum, ':');
-					} else while (1) {
+					} else if (found) while (1) {
+						/* (-ov: matched_range is not valid, nothing to print) */
 						unsigned start = gl->matched_range.rm_so;
 						unsigned end = gl->matched_range.rm_eo;
 						unsigned len = end - start;
-						char old = line[end];
-						line[end] = '\0';
 						/* Empty match is not printed: try "echo test | grep -o ''" */
 						if (len != 0)
 							print_line(line + start, len, linenum, ':');
-						if (old == '\0')
+						if (end >= line_len)
 							break;
-						line[end] = old;
 						if (len == 0)
 							end++;
 #if !ENABLE_EXTRA_COMPAT
+						gl->matched_range.rm_so = 0;
+						gl->matched_range.rm_eo = line_len - end;
 						if (regexec(&gl->compiled_regex, line + end,
-								1, &gl->matched_range, REG_NOTBOL) != 0)
+								1, &gl->matched_range, REG_NOTBOL | REG_STARTEND) != 0)
 							break;
 						gl->matched_range.rm_so += end;
 						gl->matched_range.rm_eo += end;
@@ -554,23 +930,17 @@ static int grep_file(FILE *file)
 		else { /* no match */
 			/* if we need to print some context lines after the last match, do so */
 			if (print_n_lines_after) {
-				print_line(line, strlen(line), linenum, '-');
+				print_line(line, line_len, linenum, '-');
 				print_n_lines_after--;
 			} else if (lines_before) {
 				/* Add the line to the circular 'before' buffer */
 				free(before_buf[curpos]);
-				before_buf[curpos] = line;
-				IF_EXTRA_COMPAT(before_buf_size[curpos] = line_len;)
+				before_buf[curpos] = memcpy(xmalloc(line_len + 1), line, line_len);
+				before_buf_size[curpos] = line_len;
 				curpos = (curpos + 1) % lines_before;
-				/* avoid free(line) - we took the line */
-				line = NULL;
 			}
 		}
-
 #endif /* ENABLE_FEATURE_GREP_CONTEXT */
-#if !ENABLE_EXTRA_COMPAT
-		free(line);
-#endif
 		/* Did we print all context after last requested match? */
 		if ((option_mask32 & OPT_m)
 		 && !print_n_lines_after
@@ -578,7 +948,8 @@ static int grep_file(FILE *file)
 		) {
 			break;
 		}
-	} /* while (read line) */
+	} /* for (read line) */
+	line_reader_free(lr);
 
 	/* special-case file post-processing for options where we don't print line
 	 * matches, just filenames and possibly match counts */
@@ -638,13 +1009,54 @@ static void load_regexes_from_file(llist_t *fopt)
 	}
 }
 
+static int grep_one_file(const char *filename)
+{
+	FILE *file;
+	int matched;
+
+	file = fopen_for_read(filename);
+	if (file == NULL) {
+		if (!SUPPRESS_ERR_MSGS)
+			bb_simple_perror_msg(filename);
+		open_errors = 1;
+		return 0;
+	}
+	cur_file = filename;
+	matched = grep_file(file);
+	fclose(file);
+	return matched;
+}
+
+#if ENABLE_FEATURE_GREP_PARALLEL
+/* Files found by the tree walk are searched by workers of the pool
+ * in batches. The pool copies their output to stdout in the order
+ * batches were started, and adds up their match counts.
+ */
+#define GREP_BATCH 32
+static void grep_pool_start(void)
+{
+	unsigned long long *matched;
+	unsigned i;
+
+	if (G.nfiles == 0)
+		return;
+	matched = proc_pool_fork(pool);
+	if (matched) {
+		for (i = 0; i < G.nfiles; i++)
+			*matched += grep_one_file(G.files[i]);
+		fflush_stdout_and_exit(open_errors);
+	}
+	for (i = 0; i < G.nfiles; i++)
+		free(G.files[i]);
+	G.nfiles = 0;
+}
+#endif
+
 static int FAST_FUNC file_action_grep(const char *filename,
 			struct stat *statbuf,
 			void* matched,
 			int depth UNUSED_PARAM)
 {
-	FILE *file;
-
 	/* If we are given a link to a directory, we should bail out now, rather
 	 * than trying to open the "file" and hoping getline gives us nothing,
 	 * since that is not portable across operating systems (FreeBSD for
@@ -660,16 +1072,15 @@ static int FAST_FUNC file_action_grep(const char *filename,
 			return 1;
 	}
 
-	file = fopen_for_read(filename);
-	if (file == NULL) {
-		if (!SUPPRESS_ERR_MSGS)
-			bb_simple_perror_msg(filename);
-		open_errors = 1;
-		return 0;
+#if ENABLE_FEATURE_GREP_PARALLEL
+	if (pool) {
+		G.files[G.nfiles++] = xstrdup(filename);
+		if (G.nfiles == GREP_BATCH)
+			grep_pool_start();
+		return 1;
 	}
-	cur_file = filename;
-	*(int*)matched += grep_file(file);
-	fclose(file);
+#endif
+	*(int*)matched += grep_one_file(filename);
 	return 1;
 }
 
@@ -679,11 +1090,23 @@ static int grep_dir(const char *dir)
 	recursive_action(dir,
 		/* recurse=yes */ ACTION_RECURSE |
 		/* followLinks=command line only */ ACTION_FOLLOWLINKS_L0 |
-		/* depthFirst=yes */ ACTION_DEPTHFIRST,
+		/* depthFirst=yes */ ACTION_DEPTHFIRST |
+		/* only S_ISLNK is checked */ ACTION_NOSTAT,
 		/* fileAction= */ file_action_grep,
 		/* dirAction= */ NULL,
 		/* userData= */ &matched,
 		/* depth= */ 0);
+#if ENABLE_FEATURE_GREP_PARALLEL
+	if (pool) {
+		grep_pool_start();
+		proc_pool_wait(pool);
+		/* Failed worker has already complained, just make exitcode 2 */
+		if (pool->exitcode)
+			open_errors = 1;
+		matched = pool->total;
+		pool->total = 0;
+	}
+#endif
 	return matched;
 }
 
@@ -707,7 +1130,8 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 	opts = getopt32(argv,
 		"^" OPTSTR_GREP "\0" "H-h:C-AB",
 		&pattern_head, &fopt, &max_matches,
-		&lines_after, &lines_before, &Copt);
+		&lines_after, &lines_before, &Copt
+		IF_FEATURE_GREP_PARALLEL(, &G.nworkers));
 
 	if (opts & OPT_C) {
 		/* -C unsets prev -A and -B, but following -A or -B
@@ -727,12 +1151,13 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 			lines_before = INT_MAX / sizeof(long long);
 		/* overflow in (lines_before * sizeof(x)) is prevented (above) */
 		before_buf = xzalloc(lines_before * sizeof(before_buf[0]));
-		IF_EXTRA_COMPAT(before_buf_size = xzalloc(lines_before * sizeof(before_buf_size[0]));)
+		before_buf_size = xzalloc(lines_before * sizeof(before_buf_size[0]));
 	}
 #else
 	/* with auto sanity checks */
 	getopt32(argv, "^" OPTSTR_GREP "\0" "H-h:c-n:q-n:l-n:", // why trailing ":"?
-		&pattern_head, &fopt, &max_matches);
+		&pattern_head, &fopt, &max_matches
+		IF_FEATURE_GREP_PARALLEL(, &G.nworkers));
 #endif
 	invert_search = ((option_mask32 & OPT_v) != 0); /* 0 | 1 */
 
@@ -794,6 +1219,50 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 		llist_add_to(&pattern_head, pattern);
 	}
 
+	if (FGREP_FLAG) {
+		if (pattern_head->link) {
+			llist_t *cur;
+			/* Empty pattern matches at every position, strstr() loop
+			 * handles it just fine */
+			for (cur = pattern_head; cur; cur = cur->link)
+				if (((grep_list_data_t *)cur->data)->pattern[0] == '\0')
+					break;
+			if (!cur)
+				ac = ac_build();
+		}
+	} else {
+		llist_t *cur;
+		for (cur = pattern_head; cur; cur = cur->link) {
+			grep_list_data_t *gl = (grep_list_data_t *)cur->data;
+			gl->required = required_literal(gl->pattern,
+					(reflags & REG_EXTENDED) == REG_EXTENDED);
+		}
+	}
+	/* Can we skip lines which can't match without looking
+	 * at each of them? Not if they may be printed */
+	if (!invert_search IF_FEATURE_GREP_CONTEXT(&& lines_before == 0)) {
+		if (ac) {
+			skip_lines = 1;
+		} else if (!pattern_head->link && !(option_mask32 & OPT_i)) {
+			grep_list_data_t *gl = (grep_list_data_t *)pattern_head->data;
+			needle = FGREP_FLAG ? gl->pattern : gl->required;
+			skip_lines = (needle && needle[0]);
+		}
+	}
+
+#if ENABLE_FEATURE_GREP_PARALLEL
+	/* Workers can't know whether "--" is needed before their
+	 * first context group, so -A/-B/-C searches serially.
+	 * So does -q: it only needs the first match */
+	if ((option_mask32 & (OPT_j|OPT_r)) == (OPT_j|OPT_r)
+	 && G.nworkers > 1 && !BE_QUIET
+	 IF_FEATURE_GREP_CONTEXT(&& lines_before == 0 && lines_after == 0)
+	) {
+		pool = proc_pool_new(G.nworkers);
+		G.files = xmalloc(GREP_BATCH * sizeof(G.files[0]));
+	}
+#endif
+
 	/* argv[0..(argc-1)] should be names of file to grep through. If
 	 * there is more than one file to grep, we will print the filenames. */
 	if (argv[0] && argv[1])
@@ -838,6 +1307,12 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 
 	/* destroy all the elements in the pattern list */
 	if (ENABLE_FEATURE_CLEAN_UP) {
+		if (ac) {
+			free(ac->node);
+			free(ac->gl);
+			free(ac->len);
+			free(ac);
+		}
 		while (pattern_head) {
 			llist_t *pattern_head_ptr = pattern_head;
 			grep_list_data_t *gl = (grep_list_data_t *)pattern_head_ptr->data;
@@ -847,6 +1322,7 @@ int grep_main(int argc UNUSED_PARAM, char **argv)
 				free(gl->pattern);
 			if (gl->flg_mem_allocated_compiled & COMPILED)
 				regfree(&gl->compiled_regex);
+			free(gl->required);
 			free(gl);
 			free(pattern_head_ptr);
 		}
@@ -453,12 +453,44 @@ enum {
 	/*ACTION_REVERSE      = (1 << 4), - unused */
 	ACTION_QUIET          = (1 << 5),
 	ACTION_DANGLING_OK    = (1 << 6),
+	/* Actions only need the file type from statbuf */
+	ACTION_NOSTAT         = (1 << 7),
 };
 typedef uint8_t recurse_flags_t;
 extern int recursive_action(const char *fileName, unsigned flags,
 	int FAST_FUNC (*fileAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
 	int FAST_FUNC (*dirAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
 	void* userData, unsigned depth) FAST_FUNC;
+/* Worker processes whose output is copied to stdout
+ * in the order they were started (see proc_pool.c) */
+typedef struct proc_pool_t {
+	unsigned nworkers;
+	int outfd;                 /* collected from workers, default STDOUT_FILENO */
+	unsigned running;          /* jobs in the ring */
+	unsigned first;            /* the oldest of them */
+	int exitcode;              /* of the first worker which failed */
+	unsigned long long total;  /* sum of collected workers' results */
+	unsigned long long *results;
+	struct proc_pool_job *job;
+	struct pollfd *pfd;
+} proc_pool_t;
+proc_pool_t* proc_pool_new(unsigned nworkers) FAST_FUNC;
+unsigned long long* proc_pool_fork(proc_pool_t *p) FAST_FUNC;
+void proc_pool_wait(proc_pool_t *p) FAST_FUNC;
+int proc_pool_walk_dir(proc_pool_t *p, DIR *dir, int follow_links,
+	int FAST_FUNC (*entryAction)(const char *name, unsigned d_type,
+		unsigned long long *result, void *userData),
+	int FAST_FUNC (*workerExit)(int exitcode),
+	void *userData) FAST_FUNC;
+/* recursive_action() which walks the entries of fileName
+ * (if it is a directory) in the workers of pool.
+ * workerExit, if not NULL, is called by each worker
+ * with the exit code it is about to use, and returns new one */
+extern int recursive_action_parallel(const char *fileName, unsigned flags,
+	int FAST_FUNC (*fileAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
+	int FAST_FUNC (*dirAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
+	void* userData, unsigned depth,
+	proc_pool_t *pool, int FAST_FUNC (*workerExit)(int exitcode)) FAST_FUNC;
 extern int device_open(const char *device, int mode) FAST_FUNC;
 enum { GETPTY_BUFSIZE = 16 }; /* more than enough for "/dev/ttyXXX" */
 extern int xgetpty(char *line) FAST_FUNC;
@@ -946,6 +978,37 @@ extern char *xmalloc_fgetline(FILE *file) FAST_FUNC RETURNS_MALLOC;
 /* Same, but doesn't try to conserve space (may have some slack after the end) */
 /* extern char *xmalloc_fgetline_fast(FILE *file) FAST_FUNC RETURNS_MALLOC; */
 
+/* Reads lines from fd without malloc'ing each one.
+ * Regular files are mmapped, other input is read in large blocks.
+ * line_reader_next() returns the next line without the delimiter
+ * and stores its length in *lenp, or returns NULL on EOF.
+ * The line is not NUL-terminated, may contain NULs and is read-only.
+ * It is valid until the next call (until line_reader_free() if lr->mapped).
+ * line_reader_next_str() returns the line NUL-terminated and writable
+ * (copied if the file is mapped), valid until the next call. Like in xmalloc_fgetline(), a NUL byte
+ * ends the line too. lenp can be NULL. Both die on read error.
+ * line_reader_free() does not close fd.
+ */
+typedef struct line_reader_t {
+	char *buf;
+	size_t pos, end, size;
+	char *line;         /* line_reader_next_str() copy of a mapped line */
+	size_t line_size;
+	int fd;
+	smallint mapped;
+	smallint eof;
+	smallint no_delim;  /* last line returned was not terminated */
+#if ENABLE_PLATFORM_MINGW32
+	smallint keep_cr;   /* don't strip CR before '\n' */
+#endif
+} line_reader_t;
+line_reader_t* line_reader_fdopen(int fd) FAST_FUNC;
+char* line_reader_next(line_reader_t *lr, int delim, size_t *lenp) FAST_FUNC;
+char* line_reader_next_str(line_reader_t *lr, int delim, size_t *lenp) FAST_FUNC;
+void line_reader_free(line_reader_t *lr) FAST_FUNC;
+/* Count occurrences of byte c in buf */
+size_t bb_memcount(const void *buf, int c, size_t len) FAST_FUNC;
+
 void die_if_ferror(FILE *file, const char *msg) FAST_FUNC;
 void die_if_ferror_stdout(void) FAST_FUNC;
 int fflush_all(void) FAST_FUNC;
@@ -1970,6 +2033,7 @@ extern uint32_t *global_crc32_table;
 uint32_t *crc32_filltable(uint32_t *tbl256, int endian) FAST_FUNC;
 uint32_t crc32_block_endian1(uint32_t val, const void *buf, unsigned len, uint32_t *crc_table) FAST_FUNC;
 uint32_t crc32_block_endian0(uint32_t val, const void *buf, unsigned len, uint32_t *crc_table) FAST_FUNC;
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, off_t len2) FAST_FUNC;
 
 typedef struct masks_labels_t {
 	const char *labels;
@@ -406,6 +406,7 @@ typedef unsigned smalluint;
 #define HAVE_CLEARENV 1
 #define HAVE_FDATASYNC 1
 #define HAVE_DPRINTF 1
+#define HAVE_MEMMEM 1
 #define HAVE_MEMRCHR 1
 #define HAVE_MKDTEMP 1
 #define HAVE_TTYNAME_R 1
@@ -444,6 +445,7 @@ typedef unsigned smalluint;
 #if ENABLE_PLATFORM_MINGW32
 # undef HAVE_DPRINTF
 # undef HAVE_GETLINE
+# undef HAVE_MEMMEM
 # undef HAVE_MEMRCHR
 # undef HAVE_MKDTEMP
 # undef HAVE_SETBIT
@@ -464,6 +466,7 @@ typedef unsigned smalluint;
 #if defined(__WATCOMC__)
 # undef HAVE_DPRINTF
 # undef HAVE_GETLINE
+# undef HAVE_MEMMEM
 # undef HAVE_MEMRCHR
 # undef HAVE_MKDTEMP
 # undef HAVE_SETBIT
@@ -574,6 +577,12 @@ typedef unsigned smalluint;
 extern int dprintf(int fd, const char *format, ...);
 #endif
 
+#ifndef HAVE_MEMMEM
+#include <stddef.h>
+extern void *memmem(const void *haystack, size_t haystack_len,
+		const void *needle, size_t needle_len) FAST_FUNC;
+#endif
+
 #ifndef HAVE_MEMRCHR
 #include <stddef.h>
 extern void *memrchr(const void *s, int c, size_t n) FAST_FUNC;
@@ -13,6 +13,11 @@
 
 #include <regex.h>
 
+/* Only our bundled regex (win32/regex.c) has the cached DFA search mode */
+#ifndef REG_DFA
+# define REG_DFA 0
+#endif
+
 PUSH_AND_SET_FUNCTION_VISIBILITY_TO_HIDDEN
 
 char* regcomp_or_errmsg(regex_t *preg, const char *regex, int cflags) FAST_FUNC;
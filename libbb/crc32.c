@@ -42,10 +42,147 @@ uint32_t* FAST_FUNC crc32_filltable(uint32_t *crc_table, int endian)
 	return crc_table - 256;
 }
 
+#if ENABLE_FEATURE_FAST_CRC32
+/* Slice-by-8: table[k][i] is crc of byte i followed by k zero bytes.
+ * Only two polynomials are used, so tables are ours, not the caller's.
+ */
+static uint32_t *crc32_slice_table[2];
+
+static uint32_t *get_slice_table(int endian)
+{
+	uint32_t *t = crc32_slice_table[endian];
+	unsigned i;
+
+	if (!t) {
+		t = xmalloc(8 * 256 * sizeof(t[0]));
+		crc32_filltable(t, endian);
+		for (i = 256; i < 8 * 256; i++) {
+			uint32_t c = t[i - 256];
+			t[i] = endian ? (c << 8) ^ t[c >> 24] : (c >> 8) ^ t[(uint8_t)c];
+		}
+		crc32_slice_table[endian] = t;
+	}
+	return t;
+}
+
+# if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <cpuid.h>
+#  include <immintrin.h>
+#  define CRC32_PCLMUL 1
+
+/* Carry-less multiplication folding, see Intel's "Fast CRC Computation
+ * for Generic Polynomials Using PCLMULQDQ Instruction".
+ * Constants are for the bit-reflected 0xedb88320 polynomial.
+ * len must be >= 64 and a multiple of 16.
+ */
+static uint32_t __attribute__((target("pclmul,sse2")))
+crc32_pclmul(uint32_t crc, const uint8_t *buf, unsigned len)
+{
+	__m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+	__m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+	__m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+	__m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+	__m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	__m128i x1, x2, x3, x4, t1, t2, t3, t4;
+
+	x1 = _mm_loadu_si128((void*)(buf + 0x00));
+	x2 = _mm_loadu_si128((void*)(buf + 0x10));
+	x3 = _mm_loadu_si128((void*)(buf + 0x20));
+	x4 = _mm_loadu_si128((void*)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	buf += 64;
+	len -= 64;
+
+	/* Fold 4x128 bits at a time */
+	while (len >= 64) {
+		t1 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+		t2 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+		t3 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+		t4 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, t1), _mm_loadu_si128((void*)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, t2), _mm_loadu_si128((void*)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, t3), _mm_loadu_si128((void*)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, t4), _mm_loadu_si128((void*)(buf + 0x30)));
+		buf += 64;
+		len -= 64;
+	}
+
+	/* Fold into 128 bits, then 128 bits at a time */
+#  define FOLD128(x, y) do { \
+		t1 = _mm_clmulepi64_si128(x, k3k4, 0x00); \
+		x = _mm_clmulepi64_si128(x, k3k4, 0x11); \
+		x = _mm_xor_si128(_mm_xor_si128(x, y), t1); \
+	} while (0)
+	FOLD128(x1, x2);
+	FOLD128(x1, x3);
+	FOLD128(x1, x4);
+	while (len >= 16) {
+		FOLD128(x1, _mm_loadu_si128((void*)buf));
+		buf += 16;
+		len -= 16;
+	}
+#  undef FOLD128
+
+	/* Fold 128 bits to 64 */
+	x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, mask32);
+	x1 = _mm_clmulepi64_si128(x1, k5, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x2 = _mm_and_si128(x1, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+	x2 = _mm_and_si128(x2, mask32);
+	x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	return _mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+}
+
+static int have_pclmul(void)
+{
+	static smallint cpu_checked; /* 1: no, 2: yes */
+
+	if (!cpu_checked) {
+		unsigned eax, ebx, ecx, edx;
+		cpu_checked = 1;
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)
+		 && (ecx & bit_PCLMUL) && (edx & bit_SSE2)
+		) {
+			cpu_checked = 2;
+		}
+	}
+	return cpu_checked - 1;
+}
+# endif
+#endif
+
 uint32_t FAST_FUNC crc32_block_endian1(uint32_t val, const void *buf, unsigned len, uint32_t *crc_table)
 {
 	const void *end = (uint8_t*)buf + len;
 
+#if ENABLE_FEATURE_FAST_CRC32
+	if (len >= 16) {
+		const uint32_t *t = get_slice_table(1);
+		const uint8_t *p = buf;
+
+		while (len >= 8) {
+			val ^= get_unaligned_be32(p);
+			val = t[7*256 + (val >> 24)] ^ t[6*256 + (uint8_t)(val >> 16)]
+				^ t[5*256 + (uint8_t)(val >> 8)] ^ t[4*256 + (uint8_t)val]
+				^ t[3*256 + p[4]] ^ t[2*256 + p[5]]
+				^ t[1*256 + p[6]] ^ t[p[7]];
+			p += 8;
+			len -= 8;
+		}
+		buf = p;
+	}
+#endif
 	while (buf != end) {
 		val = (val << 8) ^ crc_table[(val >> 24) ^ *(uint8_t*)buf];
 		buf = (uint8_t*)buf + 1;
@@ -57,9 +194,110 @@ uint32_t FAST_FUNC crc32_block_endian0(uint32_t val, const void *buf, unsigned l
 {
 	const void *end = (uint8_t*)buf + len;
 
+#if ENABLE_FEATURE_FAST_CRC32
+# ifdef CRC32_PCLMUL
+	if (len >= 64 && have_pclmul()) {
+		val = crc32_pclmul(val, buf, len & ~15);
+		buf = (uint8_t*)buf + (len & ~15);
+		len &= 15;
+	}
+# endif
+	if (len >= 16) {
+		const uint32_t *t = get_slice_table(0);
+		const uint8_t *p = buf;
+
+		while (len >= 8) {
+			val ^= get_unaligned_le32(p);
+			val = t[7*256 + (uint8_t)val] ^ t[6*256 + (uint8_t)(val >> 8)]
+				^ t[5*256 + (uint8_t)(val >> 16)] ^ t[4*256 + (val >> 24)]
+				^ t[3*256 + p[4]] ^ t[2*256 + p[5]]
+				^ t[1*256 + p[6]] ^ t[p[7]];
+			p += 8;
+			len -= 8;
+		}
+		buf = p;
+	}
+#endif
 	while (buf != end) {
 		val = crc_table[(uint8_t)val ^ *(uint8_t*)buf] ^ (val >> 8);
 		buf = (uint8_t*)buf + 1;
 	}
 	return val;
 }
+
+/* Multiply a and b modulo the (bit-reflected) CRC32 polynomial */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+	uint32_t m = (uint32_t)1 << 31;
+	uint32_t p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+		m >>= 1;
+		b = (b & 1) ? (b >> 1) ^ 0xedb88320 : b >> 1;
+	}
+	return p;
+}
+
+/* Given crc1 = crc32(A) and crc2 = crc32(B) (with the usual ~0 pre-
+ * and post-conditioning, as stored in .gz and .zip), return crc32(AB).
+ * len2 is the length of B.
+ */
+uint32_t FAST_FUNC crc32_combine(uint32_t crc1, uint32_t crc2, off_t len2)
+{
+	uint32_t xn = (uint32_t)1 << 31;	/* x^0 */
+	uint32_t sq = (uint32_t)1 << 23;	/* x^8: one byte */
+
+	while (len2) {
+		if (len2 & 1)
+			xn = crc32_multmodp(sq, xn);
+		sq = crc32_multmodp(sq, sq);
+		len2 >>= 1;
+	}
+	return crc32_multmodp(xn, crc1) ^ crc2;
+}
+
+#if ENABLE_UNIT_TEST
+
+BBUNIT_DEFINE_TEST(crc32)
+{
+	uint8_t buf[300];
+	uint32_t *tbl0 = crc32_filltable(NULL, 0);
+	uint32_t *tbl1 = crc32_filltable(NULL, 1);
+	unsigned i, ofs, len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = i * 131 + (i >> 3);
+
+	/* Whole blocks must match byte at a time, for all alignments */
+	for (ofs = 0; ofs < 16; ofs++) {
+		for (len = 0; ofs + len <= sizeof(buf); len += 7) {
+			uint32_t c0 = ~0, c1 = ~0;
+			for (i = ofs; i < ofs + len; i++) {
+				c0 = crc32_block_endian0(c0, buf + i, 1, tbl0);
+				c1 = crc32_block_endian1(c1, buf + i, 1, tbl1);
+			}
+			BBUNIT_ASSERT_EQ(crc32_block_endian0(~0, buf + ofs, len, tbl0), c0);
+			BBUNIT_ASSERT_EQ(crc32_block_endian1(~0, buf + ofs, len, tbl1), c1);
+		}
+	}
+	/* Well known check value */
+	BBUNIT_ASSERT_EQ(~crc32_block_endian0(~0, "123456789", 9, tbl0), 0xcbf43926);
+
+	for (len = 0; len <= sizeof(buf); len += 37) {
+		uint32_t a = ~crc32_block_endian0(~0, buf, len, tbl0);
+		uint32_t b = ~crc32_block_endian0(~0, buf + len, sizeof(buf) - len, tbl0);
+		BBUNIT_ASSERT_EQ(crc32_combine(a, b, sizeof(buf) - len),
+			~crc32_block_endian0(~0, buf, sizeof(buf), tbl0));
+	}
+
+	free(tbl0);
+	free(tbl1);
+	BBUNIT_ENDTEST;
+}
+
+#endif /* ENABLE_UNIT_TEST */
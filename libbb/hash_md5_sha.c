@@ -561,6 +561,82 @@ static void FAST_FUNC sha1_process_block64(sha1_ctx_t *ctx)
 	ctx->hash[4] += e;
 }
 
+#if (ENABLE_SHA1_HWACCEL || ENABLE_SHA256_HWACCEL) \
+ && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# include <cpuid.h>
+# include <immintrin.h>
+# define SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+static smallint shaNI_checked; /* 1: no, 2: yes */
+static int have_shaNI(void)
+{
+	if (!shaNI_checked) {
+		unsigned eax, ebx, ecx, edx;
+		shaNI_checked = 1;
+		if (__get_cpuid_max(0, NULL) >= 7
+		 && __get_cpuid(1, &eax, &ebx, &ecx, &edx)
+		 && (ecx & bit_SSSE3) && (ecx & bit_SSE4_1)
+		) {
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			if (ebx & bit_SHA)
+				shaNI_checked = 2;
+		}
+	}
+	return shaNI_checked - 1;
+}
+#else
+# define have_shaNI() 0
+#endif
+
+#if ENABLE_SHA1_HWACCEL && defined(SHA_NI_TARGET)
+/* Same as sha1_process_block64, using x86 SHA extensions.
+ * Four rounds per sha1rnds4, message schedule by sha1msg1/sha1msg2.
+ */
+static void FAST_FUNC SHA_NI_TARGET sha1_process_block64_shaNI(sha1_ctx_t *ctx)
+{
+	const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+	const uint8_t *data = ctx->wbuffer;
+	__m128i abcd, abcd_save, e_save;
+	__m128i E[2], M[4];
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((void*)ctx->hash), 0x1b);
+	E[0] = _mm_set_epi32(ctx->hash[4], 0, 0, 0);
+	abcd_save = abcd;
+	e_save = E[0];
+
+	/* i is a constant in every expansion, all ifs are resolved
+	 * at compile time. M[] and E[] end up in registers. */
+#define ROUNDS4(i) do { \
+	if (i < 4) \
+		M[i & 3] = _mm_shuffle_epi8(_mm_loadu_si128((void*)(data + 16 * (i & 3))), mask); \
+	if (i == 0) \
+		E[0] = _mm_add_epi32(E[0], M[0]); \
+	else \
+		E[i & 1] = _mm_sha1nexte_epu32(E[i & 1], M[i & 3]); \
+	E[(i + 1) & 1] = abcd; \
+	if (i >= 3 && i <= 18) \
+		M[(i + 1) & 3] = _mm_sha1msg2_epu32(M[(i + 1) & 3], M[i & 3]); \
+	abcd = _mm_sha1rnds4_epu32(abcd, E[i & 1], i / 5); \
+	if (i >= 1 && i <= 16) \
+		M[(i - 1) & 3] = _mm_sha1msg1_epu32(M[(i - 1) & 3], M[i & 3]); \
+	if (i >= 2 && i <= 17) \
+		M[(i - 2) & 3] = _mm_xor_si128(M[(i - 2) & 3], M[i & 3]); \
+} while (0)
+	ROUNDS4(0);  ROUNDS4(1);  ROUNDS4(2);  ROUNDS4(3);
+	ROUNDS4(4);  ROUNDS4(5);  ROUNDS4(6);  ROUNDS4(7);
+	ROUNDS4(8);  ROUNDS4(9);  ROUNDS4(10); ROUNDS4(11);
+	ROUNDS4(12); ROUNDS4(13); ROUNDS4(14); ROUNDS4(15);
+	ROUNDS4(16); ROUNDS4(17); ROUNDS4(18); ROUNDS4(19);
+#undef ROUNDS4
+
+	E[0] = _mm_sha1nexte_epu32(E[0], e_save);
+	abcd = _mm_add_epi32(abcd, abcd_save);
+	_mm_storeu_si128((void*)ctx->hash, _mm_shuffle_epi32(abcd, 0x1b));
+	ctx->hash[4] = _mm_extract_epi32(E[0], 3);
+}
+#else
+# define sha1_process_block64_shaNI sha1_process_block64
+#endif
+
 /* Constants for SHA512 from FIPS 180-2:4.2.3.
  * SHA256 constants from FIPS 180-2:4.2.2
  * are the most significant half of first 64 elements
@@ -692,6 +768,58 @@ static void FAST_FUNC sha256_process_block64(sha256_ctx_t *ctx)
 	ctx->hash[7] += h;
 }
 
+#if ENABLE_SHA256_HWACCEL && defined(SHA_NI_TARGET)
+/* Same as sha256_process_block64, using x86 SHA extensions.
+ * sha256rnds2 does two rounds on state kept as ABEF and CDGH halves.
+ */
+static void FAST_FUNC SHA_NI_TARGET sha256_process_block64_shaNI(sha256_ctx_t *ctx)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	const uint8_t *data = ctx->wbuffer;
+	__m128i st0, st1, tmp, msg, abef_save, cdgh_save;
+	__m128i M[4];
+
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((void*)&ctx->hash[0]), 0xb1); /* CDAB */
+	st1 = _mm_shuffle_epi32(_mm_loadu_si128((void*)&ctx->hash[4]), 0x1b); /* EFGH */
+	st0 = _mm_alignr_epi8(tmp, st1, 8);    /* ABEF */
+	st1 = _mm_blend_epi16(st1, tmp, 0xf0); /* CDGH */
+	abef_save = st0;
+	cdgh_save = st1;
+
+#define K(t) (uint32_t)(NEED_SHA512 ? (sha_K[t] >> 32) : sha_K[t])
+#define ROUNDS4(i) do { \
+	if (i < 4) \
+		M[i] = _mm_shuffle_epi8(_mm_loadu_si128((void*)(data + 16 * (i & 3))), mask); \
+	msg = _mm_add_epi32(M[i & 3], _mm_set_epi32(K(4*i + 3), K(4*i + 2), K(4*i + 1), K(4*i))); \
+	st1 = _mm_sha256rnds2_epu32(st1, st0, msg); \
+	if (i >= 3 && i <= 14) { \
+		tmp = _mm_alignr_epi8(M[i & 3], M[(i + 3) & 3], 4); \
+		M[(i + 1) & 3] = _mm_add_epi32(M[(i + 1) & 3], tmp); \
+		M[(i + 1) & 3] = _mm_sha256msg2_epu32(M[(i + 1) & 3], M[i & 3]); \
+	} \
+	msg = _mm_shuffle_epi32(msg, 0x0e); \
+	st0 = _mm_sha256rnds2_epu32(st0, st1, msg); \
+	if (i >= 1 && i <= 12) \
+		M[(i - 1) & 3] = _mm_sha256msg1_epu32(M[(i - 1) & 3], M[i & 3]); \
+} while (0)
+	ROUNDS4(0);  ROUNDS4(1);  ROUNDS4(2);  ROUNDS4(3);
+	ROUNDS4(4);  ROUNDS4(5);  ROUNDS4(6);  ROUNDS4(7);
+	ROUNDS4(8);  ROUNDS4(9);  ROUNDS4(10); ROUNDS4(11);
+	ROUNDS4(12); ROUNDS4(13); ROUNDS4(14); ROUNDS4(15);
+#undef ROUNDS4
+#undef K
+
+	st0 = _mm_add_epi32(st0, abef_save);
+	st1 = _mm_add_epi32(st1, cdgh_save);
+	tmp = _mm_shuffle_epi32(st0, 0x1b);    /* FEBA */
+	st1 = _mm_shuffle_epi32(st1, 0xb1);    /* DCHG */
+	_mm_storeu_si128((void*)&ctx->hash[0], _mm_blend_epi16(tmp, st1, 0xf0)); /* DCBA */
+	_mm_storeu_si128((void*)&ctx->hash[4], _mm_alignr_epi8(st1, tmp, 8));   /* HGFE */
+}
+#else
+# define sha256_process_block64_shaNI sha256_process_block64
+#endif
+
 #if NEED_SHA512
 static void FAST_FUNC sha512_process_block128(sha512_ctx_t *ctx)
 {
@@ -765,6 +893,8 @@ void FAST_FUNC sha1_begin(sha1_ctx_t *ctx)
 	ctx->hash[4] = 0xc3d2e1f0;
 	ctx->total64 = 0;
 	ctx->process_block = sha1_process_block64;
+	if (ENABLE_SHA1_HWACCEL && have_shaNI())
+		ctx->process_block = sha1_process_block64_shaNI;
 }
 
 static const uint32_t init256[] = {
@@ -801,6 +931,8 @@ void FAST_FUNC sha256_begin(sha256_ctx_t *ctx)
 	memcpy(&ctx->total64, init256, sizeof(init256));
 	/*ctx->total64 = 0; - done by prepending two 32-bit zeros to init256 */
 	ctx->process_block = sha256_process_block64;
+	if (ENABLE_SHA256_HWACCEL && have_shaNI())
+		ctx->process_block = sha256_process_block64_shaNI;
 }
 
 #if NEED_SHA512
@@ -872,7 +1004,12 @@ unsigned FAST_FUNC sha1_end(sha1_ctx_t *ctx, void *resbuf)
 	/* SHA stores total in BE, need to swap on LE arches: */
 	common64_end(ctx, /*swap_needed:*/ BB_LITTLE_ENDIAN);
 
-	hash_size = (ctx->process_block == sha1_process_block64) ? 5 : 8;
+	hash_size = 8;
+	if (ctx->process_block == sha1_process_block64
+	 || ctx->process_block == sha1_process_block64_shaNI
+	) {
+		hash_size = 5;
+	}
 	/* This way we do not impose alignment constraints on resbuf: */
 	if (BB_LITTLE_ENDIAN) {
 		unsigned i;
@@ -1480,3 +1617,66 @@ unsigned FAST_FUNC sha3_end(sha3_ctx_t *ctx, void *resbuf)
 	memcpy(resbuf, ctx->state, 64);
 	return 64;
 }
+
+#if ENABLE_UNIT_TEST
+
+static char *sha_hex(md5sha_ctx_t *ctx, void FAST_FUNC (*process_block)(md5sha_ctx_t*),
+		const char *str, unsigned repeat, char *hex)
+{
+	uint8_t hash[32];
+	unsigned len;
+
+	ctx->process_block = process_block;
+	while (repeat--)
+		md5sha_hash(ctx, str, strlen(str));
+	len = sha_end(ctx, hash);
+	*bin2hex(hex, (char*)hash, len) = '\0';
+	return hex;
+}
+
+BBUNIT_DEFINE_TEST(sha1_sha256)
+{
+	static const char a1000[] ALIGN1 = /* million "a"s when repeated */
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"
+		"aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
+	static const char abc448[] ALIGN1 =
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	md5sha_ctx_t ctx;
+	char hex[65];
+	int hw;
+
+	/* Generic code, then SHA-NI if this CPU has it */
+	for (hw = 0; hw <= have_shaNI(); hw++) {
+		sha1_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha1_process_block64_shaNI : sha1_process_block64, "abc", 1, hex),
+			"a9993e364706816aba3e25717850c26c9cd0d89d");
+		sha1_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha1_process_block64_shaNI : sha1_process_block64, abc448, 1, hex),
+			"84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+		sha1_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha1_process_block64_shaNI : sha1_process_block64, a1000, 1000, hex),
+			"34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+
+		sha256_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha256_process_block64_shaNI : sha256_process_block64, "abc", 1, hex),
+			"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		sha256_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha256_process_block64_shaNI : sha256_process_block64, abc448, 1, hex),
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+		sha256_begin(&ctx);
+		BBUNIT_ASSERT_STREQ(sha_hex(&ctx, hw ? sha256_process_block64_shaNI : sha256_process_block64, a1000, 1000, hex),
+			"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+	}
+
+	BBUNIT_ENDTEST;
+}
+
+#endif /* ENABLE_UNIT_TEST */
@@ -0,0 +1,149 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Utility routines.
+ *
+ * Line reader which does not malloc every line.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+//kbuild:lib-y += line_reader.o
+
+#include "libbb.h"
+
+/* Block size for non-mmapable input */
+#define LINE_READER_BUFSIZE (64 * 1024)
+
+line_reader_t* FAST_FUNC line_reader_fdopen(int fd)
+{
+	line_reader_t *lr = xzalloc(sizeof(*lr));
+
+	lr->fd = fd;
+	lr->size = LINE_READER_BUFSIZE;
+#if !ENABLE_PLATFORM_MINGW32
+	{
+		struct stat st;
+		off_t ofs;
+
+		ofs = lseek(fd, 0, SEEK_CUR);
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && ofs >= 0) {
+			/* Regular files are mapped, unless they are too big for
+			 * our address space. The mapping is read-only: writing
+			 * to it would copy every page we touch */
+			if (ofs < st.st_size
+			 && st.st_size == (off_t)(size_t)st.st_size
+			) {
+				void *p = mmap(NULL, st.st_size, PROT_READ,
+						MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED) {
+					lr->buf = p;
+					lr->size = lr->end = st.st_size;
+					lr->pos = ofs;
+					lr->mapped = 1;
+					lr->eof = 1;
+					return lr;
+				}
+			}
+			/* Empty (or small) file: don't allocate a whole block,
+			 * "grep -r" over many empty files spends most of
+			 * its time on this. Buffer grows if file grows */
+			if (st.st_size - ofs < LINE_READER_BUFSIZE - 256)
+				lr->size = (st.st_size > ofs ? st.st_size - ofs : 0) + 256;
+		}
+	}
+#endif
+	lr->buf = xmalloc(lr->size);
+	return lr;
+}
+
+char* FAST_FUNC line_reader_next(line_reader_t *lr, int delim, size_t *lenp)
+{
+	char *line, *p;
+	size_t len;
+
+	for (;;) {
+		line = lr->buf + lr->pos;
+		p = memchr(line, delim, lr->end - lr->pos);
+		if (p) {
+			lr->pos = p + 1 - lr->buf;
+			lr->no_delim = 0;
+			break;
+		}
+		if (lr->eof) {
+			if (lr->pos == lr->end)
+				return NULL;
+			lr->no_delim = 1;
+			p = lr->buf + lr->end;
+			lr->pos = lr->end;
+			break;
+		}
+		/* Need more data: move partial line to the start... */
+		if (lr->pos != 0) {
+			lr->end -= lr->pos;
+			memmove(lr->buf, line, lr->end);
+			lr->pos = 0;
+		}
+		/* ...and grow buffer if the line doesn't fit.
+		 * One byte is left for line_reader_next_str() to put NUL */
+		if (lr->end >= lr->size - 1) {
+			lr->size *= 2;
+			lr->buf = xrealloc(lr->buf, lr->size);
+		}
+		len = safe_read(lr->fd, lr->buf + lr->end, lr->size - 1 - lr->end);
+		if ((ssize_t)len < 0)
+			bb_perror_msg_and_die(bb_msg_read_error);
+		if (len == 0)
+			lr->eof = 1;
+		lr->end += len;
+	}
+	len = p - line;
+#if ENABLE_PLATFORM_MINGW32
+	if (delim == '\n' && !lr->keep_cr && len && line[len - 1] == '\r')
+		len--;
+#endif
+	*lenp = len;
+	return line;
+}
+
+char* FAST_FUNC line_reader_next_str(line_reader_t *lr, int delim, size_t *lenp)
+{
+	char *line, *nul;
+	size_t len;
+
+	line = line_reader_next(lr, delim, &len);
+	if (!line)
+		return line;
+	/* As in bb_get_chunk_from_file(), NUL ends the line too:
+	 * what follows it is returned by the next call */
+	nul = memchr(line, '\0', len);
+	if (nul) {
+		len = nul - line;
+		lr->pos = nul + 1 - lr->buf;
+		lr->no_delim = 0;
+	}
+	if (lr->mapped) {
+		if (lr->line_size <= len) {
+			lr->line_size = len + 1;
+			free(lr->line);
+			lr->line = xmalloc(lr->line_size);
+		}
+		line = memcpy(lr->line, line, len);
+	}
+	line[len] = '\0';
+	if (lenp)
+		*lenp = len;
+	return line;
+}
+
+void FAST_FUNC line_reader_free(line_reader_t *lr)
+{
+#if !ENABLE_PLATFORM_MINGW32
+	if (lr->mapped) {
+		/* Leave file offset after what we consumed */
+		lseek(lr->fd, lr->pos, SEEK_SET);
+		munmap(lr->buf, lr->size);
+	} else
+#endif
+		free(lr->buf);
+	free(lr->line);
+	free(lr);
+}
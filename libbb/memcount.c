@@ -0,0 +1,93 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Utility routines.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+//kbuild:lib-y += memcount.o
+
+#include "libbb.h"
+#if ENABLE_FEATURE_FAST_LINE_SCAN
+# if defined(__AVX2__)
+#  include <immintrin.h>
+# elif defined(__SSE2__)
+#  include <emmintrin.h>
+# endif
+#endif
+
+/* Count occurrences of byte c in buf (think "wc -l") */
+size_t FAST_FUNC bb_memcount(const void *buf, int c, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t cnt = 0;
+
+#if ENABLE_FEATURE_FAST_LINE_SCAN
+# if defined(__AVX2__)
+	__m256i needle = _mm256_set1_epi8(c);
+	while (len >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		cnt += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle)));
+		p += 32;
+		len -= 32;
+	}
+# elif defined(__SSE2__)
+	__m128i needle = _mm_set1_epi8(c);
+	while (len >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		cnt += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle)));
+		p += 16;
+		len -= 16;
+	}
+# else
+	/* Word at a time: bytes equal to c become zero after XOR,
+	 * then each zero byte is turned into 0x80 and counted */
+	const unsigned long ones = (unsigned long)-1 / 0xff;
+	const unsigned long lows = ones * 0x7f;
+	const unsigned long pattern = ones * (unsigned char)c;
+
+	while (len && ((uintptr_t)p & (sizeof(long) - 1))) {
+		cnt += (*p++ == (unsigned char)c);
+		len--;
+	}
+	while (len >= sizeof(long)) {
+		unsigned long w = *(const unsigned long *)p ^ pattern;
+		/* exact (no false positives from borrows) zero byte test */
+		w = ~(((w & lows) + lows) | w | lows);
+		/* sum the 0/1 bytes into the top byte */
+		cnt += ((w >> 7) * ones) >> ((sizeof(long) - 1) * 8);
+		p += sizeof(long);
+		len -= sizeof(long);
+	}
+# endif
+#endif
+	while (len--)
+		cnt += (*p++ == (unsigned char)c);
+	return cnt;
+}
+
+#if ENABLE_UNIT_TEST
+
+BBUNIT_DEFINE_TEST(bb_memcount)
+{
+	char buf[200];
+	unsigned i, ofs, len;
+
+	for (i = 0; i < sizeof(buf); i++)
+		buf[i] = (i * 7 % 5) ? 'x' : '\n';
+	buf[150] = (char)0x8a; /* '\n' with high bit set: must not match */
+
+	/* All alignments and tail lengths */
+	for (ofs = 0; ofs < 40; ofs++) {
+		for (len = 0; ofs + len <= sizeof(buf); len += 13) {
+			size_t cnt = 0;
+			for (i = ofs; i < ofs + len; i++)
+				cnt += (buf[i] == '\n');
+			BBUNIT_ASSERT_EQ(bb_memcount(buf + ofs, '\n', len), cnt);
+		}
+	}
+	BBUNIT_ASSERT_EQ(bb_memcount(buf, 0x8a, sizeof(buf)), 1);
+
+	BBUNIT_ENDTEST;
+}
+
+#endif /* ENABLE_UNIT_TEST */
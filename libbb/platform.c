@@ -81,6 +81,28 @@ int dprintf(int fd, const char *format, ...)
 }
 #endif
 
+#ifndef HAVE_MEMMEM
+void* FAST_FUNC memmem(const void *haystack, size_t haystack_len,
+		const void *needle, size_t needle_len)
+{
+	const char *p = haystack;
+	const char *end = p + haystack_len;
+
+	if (needle_len == 0)
+		return (void *) p;
+	while (haystack_len >= needle_len) {
+		p = memchr(p, *(const char *)needle, haystack_len - needle_len + 1);
+		if (!p)
+			break;
+		if (memcmp(p, needle, needle_len) == 0)
+			return (void *) p;
+		p++;
+		haystack_len = end - p;
+	}
+	return NULL;
+}
+#endif
+
 #ifndef HAVE_MEMRCHR
 /* Copyright (C) 2005 Free Software Foundation, Inc.
  * memrchr() is a GNU function that might not be available everywhere.
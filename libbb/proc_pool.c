@@ -0,0 +1,242 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Utility routines.
+ *
+ * Pool of worker processes whose output comes out in order.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+//kbuild:lib-$(CONFIG_FEATURE_PROC_POOL) += proc_pool.o
+
+#include "libbb.h"
+
+/* Each job runs in a forked worker with p->outfd (stdout unless
+ * the caller sets another one, say, stderr) redirected into a pipe.
+ * We read all pipes as data arrives: output of the oldest job goes
+ * straight to our p->outfd, output of the others is held in memory
+ * until their turn comes. Thus the output is the same as if the jobs
+ * were run one after another, and a worker never stalls on a full
+ * pipe waiting for the ones started before it.
+ */
+
+#define POOL_READ_SIZE (16 * 1024)
+
+struct proc_pool_job {
+	pid_t pid;
+	int fd;         /* -1: EOF seen */
+	unsigned len;
+	unsigned size;
+	char *buf;      /* output held until this job is the oldest */
+};
+
+proc_pool_t* FAST_FUNC proc_pool_new(unsigned nworkers)
+{
+	proc_pool_t *p = xzalloc(sizeof(*p));
+
+	p->nworkers = nworkers;
+	p->outfd = STDOUT_FILENO;
+	p->job = xzalloc(nworkers * sizeof(p->job[0]));
+	p->pfd = xmalloc(nworkers * sizeof(p->pfd[0]));
+	/* Workers pass their results back through shared memory */
+	p->results = mmap(NULL, nworkers * sizeof(p->results[0]),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (p->results == MAP_FAILED)
+		bb_simple_perror_msg_and_die("mmap");
+	return p;
+}
+
+/* The oldest job has finished: collect it, and write out
+ * what the next one has produced so far */
+static void proc_pool_reap_first(proc_pool_t *p)
+{
+	struct proc_pool_job *j = &p->job[p->first];
+	int status;
+
+	status = wait_for_exitstatus(j->pid);
+	if (!p->exitcode)
+		p->exitcode = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+	p->total += p->results[p->first];
+	p->first = (p->first + 1) % p->nworkers;
+	p->running--;
+
+	j = &p->job[p->first];
+	if (p->running && j->len) {
+		xwrite(p->outfd, j->buf, j->len);
+		j->len = 0;
+	}
+}
+
+/* Copy out workers' output until no more than max_running jobs are left */
+static void proc_pool_pump(proc_pool_t *p, unsigned max_running)
+{
+	while (p->running > max_running) {
+		unsigned i, n;
+
+		n = 0;
+		for (i = 0; i < p->running; i++) {
+			unsigned k = (p->first + i) % p->nworkers;
+			if (p->job[k].fd >= 0) {
+				p->pfd[n].fd = p->job[k].fd;
+				p->pfd[n].events = POLLIN;
+				n++;
+			}
+		}
+		if (safe_poll(p->pfd, n, -1) < 0)
+			bb_simple_perror_msg_and_die("poll");
+
+		for (i = 0, n = 0; i < p->running; i++) {
+			unsigned k = (p->first + i) % p->nworkers;
+			struct proc_pool_job *j = &p->job[k];
+			ssize_t r;
+
+			if (j->fd < 0)
+				continue;
+			if (!p->pfd[n++].revents)
+				continue;
+			if (j->size - j->len < POOL_READ_SIZE) {
+				j->size = j->len * 2 + POOL_READ_SIZE;
+				j->buf = xrealloc(j->buf, j->size);
+			}
+			r = safe_read(j->fd, j->buf + j->len, POOL_READ_SIZE);
+			if (r < 0)
+				bb_simple_perror_msg_and_die(bb_msg_read_error);
+			if (r == 0) {
+				close(j->fd);
+				j->fd = -1;
+				continue;
+			}
+			j->len += r;
+			if (k == p->first) {
+				xwrite(p->outfd, j->buf, j->len);
+				j->len = 0;
+			}
+		}
+
+		while (p->running && p->job[p->first].fd < 0)
+			proc_pool_reap_first(p);
+	}
+}
+
+/* Returns NULL in the parent. In the worker, returns the (zeroed)
+ * slot where it can store its result: these are added up
+ * into p->total. Worker should exit when it's done */
+unsigned long long* FAST_FUNC proc_pool_fork(proc_pool_t *p)
+{
+	struct proc_pool_job *j;
+	unsigned k;
+	int pfd[2];
+	pid_t pid;
+
+	proc_pool_pump(p, p->nworkers - 1);
+
+	k = (p->first + p->running) % p->nworkers;
+	p->results[k] = 0;
+	xpipe(pfd);
+	fflush_all();
+	pid = xfork();
+	if (pid == 0) {
+		unsigned i;
+
+		/* Don't hold other workers' pipes open */
+		for (i = 0; i < p->running; i++) {
+			int fd = p->job[(p->first + i) % p->nworkers].fd;
+			if (fd >= 0)
+				close(fd);
+		}
+		close(pfd[0]);
+		xmove_fd(pfd[1], p->outfd);
+		return &p->results[k];
+	}
+	close(pfd[1]);
+	j = &p->job[k];
+	j->pid = pid;
+	j->fd = pfd[0];
+	j->len = 0;
+	p->running++;
+	return NULL;
+}
+
+void FAST_FUNC proc_pool_wait(proc_pool_t *p)
+{
+	proc_pool_pump(p, 0);
+}
+
+/* Entries of dir are handed to the workers: anything which may be
+ * a directory gets a worker of its own, other entries are batched.
+ * Worker runs entryAction on each of its entries (result is its slot,
+ * see above) and exits with EXIT_FAILURE if any of them returned FALSE,
+ * or with what workerExit (if not NULL) returns for that exit code.
+ * Returns FALSE if any worker failed.
+ */
+#define WALK_BATCH 64
+struct walk_entry {
+	unsigned char d_type;
+	char name[1];
+};
+
+static int may_be_dir(unsigned d_type, int follow_links)
+{
+	return d_type == DT_DIR || d_type == DT_UNKNOWN
+		|| (d_type == DT_LNK && follow_links);
+}
+
+int FAST_FUNC proc_pool_walk_dir(proc_pool_t *p, DIR *dir, int follow_links,
+		int FAST_FUNC (*entryAction)(const char *name, unsigned d_type,
+				unsigned long long *result, void *userData),
+		int FAST_FUNC (*workerExit)(int exitcode),
+		void *userData)
+{
+	struct walk_entry **ent = NULL;
+	struct dirent *next;
+	unsigned n, i, j;
+
+	n = 0;
+	while ((next = readdir(dir)) != NULL) {
+		unsigned len;
+
+		if (DOT_OR_DOTDOT(next->d_name))
+			continue;
+		len = strlen(next->d_name);
+		ent = xrealloc_vector(ent, 6, n);
+		ent[n] = xmalloc(sizeof(*ent[0]) + len);
+		ent[n]->d_type = next->d_type;
+		memcpy(ent[n]->name, next->d_name, len + 1);
+		n++;
+	}
+
+	p->exitcode = 0;
+	p->total = 0;
+	for (i = 0; i < n; i = j) {
+		unsigned long long *result;
+
+		j = i + 1;
+		if (!may_be_dir(ent[i]->d_type, follow_links)) {
+			while (j < n && j - i < WALK_BATCH
+			 && !may_be_dir(ent[j]->d_type, follow_links)
+			) {
+				j++;
+			}
+		}
+		result = proc_pool_fork(p);
+		if (result) {
+			int rc = EXIT_SUCCESS;
+
+			for (; i < j; i++) {
+				if (entryAction(ent[i]->name, ent[i]->d_type,
+						result, userData) == FALSE
+				) {
+					rc = EXIT_FAILURE;
+				}
+			}
+			if (workerExit)
+				rc = workerExit(rc);
+			fflush_stdout_and_exit(rc);
+		}
+	}
+	proc_pool_wait(p);
+
+	for (i = 0; i < n; i++)
+		free(ent[i]);
+	free(ent);
+	return p->exitcode ? FALSE : TRUE;
+}
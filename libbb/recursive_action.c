@@ -10,6 +10,24 @@
 
 #undef DEBUG_RECURS_ACTION
 
+/* Where we can, entries are stat'ed and opened relative to the fd
+ * of the directory being read: the kernel does not resolve the whole
+ * path again for every file, and we need not malloc a new path string
+ * for every entry either - the path passed to the actions is built
+ * in one buffer which grows as needed.
+ */
+#if !ENABLE_PLATFORM_MINGW32 && defined(AT_FDCWD) && defined(DT_UNKNOWN)
+# define WALK_AT 1
+# ifndef DTTOIF
+#  define DTTOIF(t) ((t) << 12)
+# endif
+#else
+# define WALK_AT 0
+# define AT_FDCWD -1
+# undef DT_UNKNOWN
+# define DT_UNKNOWN 0
+#endif
+
 /*
  * Walk down all the directories under the specified
  * location, and do something (something specified
@@ -63,41 +81,120 @@ static int FAST_FUNC true_action(const char *fileName UNUSED_PARAM,
  * ACTION_FOLLOWLINKS mainly controls handling of links to dirs.
  * 0: lstat(statbuf). Calls fileAction on link name even if points to dir.
  * 1: stat(statbuf). Calls dirAction and optionally recurse on link to dir.
+ *
+ * ACTION_NOSTAT: caller only looks at the file type in statbuf->st_mode.
+ * If readdir's d_type already tells it, the entry is not stat'ed at all,
+ * and only st_mode is filled in (the rest of statbuf is zero).
  */
 
-int FAST_FUNC recursive_action(const char *fileName,
-		unsigned flags,
-		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
-		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
-		void* userData,
-		unsigned depth)
+struct walk_state {
+	int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth);
+	int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth);
+	void* userData;
+	unsigned flags;
+	unsigned path_size;
+	/* Path of the current entry, passed to the actions */
+	char *path;
+#if ENABLE_FEATURE_PROC_POOL
+	proc_pool_t *pool;
+	int FAST_FUNC (*workerExit)(int exitcode);
+	unsigned pool_depth;
+#endif
+};
+
+static int walk(struct walk_state *ws, int dir_fd, const char *name,
+		unsigned pathlen, unsigned d_type, unsigned depth);
+
+/* Append name to the directory's path (pathlen chars) and walk it */
+static int walk_child(struct walk_state *ws, int dir_fd, const char *name,
+		unsigned d_type, unsigned pathlen, unsigned depth)
+{
+	unsigned len, sublen;
+	char *p;
+
+	/* Same as concat_path_file(), but in place */
+	len = strlen(name);
+	sublen = pathlen + (pathlen == 0 || ws->path[pathlen - 1] != '/');
+	if (sublen + len >= ws->path_size) {
+		ws->path_size = (sublen + len) * 2 + 64;
+		ws->path = xrealloc(ws->path, ws->path_size);
+	}
+	p = ws->path + pathlen;
+	if (sublen != pathlen)
+		*p++ = '/';
+	memcpy(p, name, len + 1);
+
+	return walk(ws, dir_fd, name, sublen + len, d_type, depth);
+}
+
+#if ENABLE_FEATURE_PROC_POOL
+/* Walking the entries of a directory in a worker of ws->pool */
+struct walk_job {
+	struct walk_state *ws;
+	int dir_fd;
+	unsigned pathlen;
+	unsigned depth;
+};
+
+static int FAST_FUNC walk_job_entry(const char *name, unsigned d_type,
+		unsigned long long *result UNUSED_PARAM, void *userData)
+{
+	struct walk_job *job = userData;
+
+	return walk_child(job->ws, job->dir_fd, name, d_type,
+			job->pathlen, job->depth + 1);
+}
+#endif
+
+/* ws->path holds the entry's path (pathlen chars).
+ * name is the same entry relative to dir_fd. */
+static int walk(struct walk_state *ws, int dir_fd, const char *name,
+		unsigned pathlen, unsigned d_type, unsigned depth)
 {
 	struct stat statbuf;
+	unsigned flags = ws->flags;
 	unsigned follow;
 	int status;
 	DIR *dir;
 	struct dirent *next;
 
-	if (!fileAction) fileAction = true_action;
-	if (!dirAction) dirAction = true_action;
-
 	follow = ACTION_FOLLOWLINKS;
 	if (depth == 0)
 		follow = ACTION_FOLLOWLINKS | ACTION_FOLLOWLINKS_L0;
 	follow &= flags;
-	status = (follow ? stat : lstat)(fileName, &statbuf);
-	if (status < 0) {
+
+#if WALK_AT
+	if ((flags & ACTION_NOSTAT)
+	 && d_type != DT_UNKNOWN
+	 && !(follow && d_type == DT_LNK)
+	) {
+		memset(&statbuf, 0, sizeof(statbuf));
+		statbuf.st_mode = DTTOIF(d_type);
+	} else
+#endif
+	{
+#if WALK_AT
+		status = fstatat(dir_fd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+#else
+		status = (follow ? stat : lstat)(ws->path, &statbuf);
+#endif
+		if (status < 0) {
 #ifdef DEBUG_RECURS_ACTION
-		bb_error_msg("status=%d flags=%x", status, flags);
+			bb_error_msg("status=%d flags=%x", status, flags);
 #endif
-		if ((flags & ACTION_DANGLING_OK)
-		 && errno == ENOENT
-		 && lstat(fileName, &statbuf) == 0
-		) {
-			/* Dangling link */
-			return fileAction(fileName, &statbuf, userData, depth);
+			if ((flags & ACTION_DANGLING_OK)
+			 && errno == ENOENT
+#if WALK_AT
+			 && fstatat(dir_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0
+#else
+			 && lstat(ws->path, &statbuf) == 0
+#endif
+			) {
+				/* Dangling link */
+				return ws->fileAction(ws->path, &statbuf, ws->userData, depth);
+			}
+			goto done_nak_warn;
 		}
-		goto done_nak_warn;
 	}
 
 	/* If S_ISLNK(m), then we know that !S_ISDIR(m).
@@ -106,24 +203,37 @@ int FAST_FUNC recursive_action(const char *fileName,
 	if ( /* (!(flags & ACTION_FOLLOWLINKS) && S_ISLNK(statbuf.st_mode)) || */
 	 !S_ISDIR(statbuf.st_mode)
 	) {
-		return fileAction(fileName, &statbuf, userData, depth);
+		return ws->fileAction(ws->path, &statbuf, ws->userData, depth);
 	}
 
 	/* It's a directory (or a link to one, and followLinks is set) */
 
 	if (!(flags & ACTION_RECURSE)) {
-		return dirAction(fileName, &statbuf, userData, depth);
+		return ws->dirAction(ws->path, &statbuf, ws->userData, depth);
 	}
 
 	if (!(flags & ACTION_DEPTHFIRST)) {
-		status = dirAction(fileName, &statbuf, userData, depth);
+		status = ws->dirAction(ws->path, &statbuf, ws->userData, depth);
 		if (status == FALSE)
 			goto done_nak_warn;
 		if (status == SKIP)
 			return TRUE;
 	}
 
-	dir = opendir(fileName);
+#if WALK_AT
+	{
+		int fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOCTTY
+				| (follow ? 0 : O_NOFOLLOW));
+		dir = NULL;
+		if (fd >= 0) {
+			dir = fdopendir(fd);
+			if (!dir)
+				close(fd);
+		}
+	}
+#else
+	dir = opendir(ws->path);
+#endif
 	if (!dir) {
 		/* findutils-4.1.20 reports this */
 		/* (i.e. it doesn't silently return with exit code 1) */
@@ -131,20 +241,32 @@ int FAST_FUNC recursive_action(const char *fileName,
 		goto done_nak_warn;
 	}
 	status = TRUE;
+#if ENABLE_FEATURE_PROC_POOL
+	if (ws->pool && depth == ws->pool_depth) {
+		/* The pool keeps output in order,
+		 * so it is the same as from a serial walk */
+		struct walk_job job = { ws, dirfd(dir), pathlen, depth };
+
+		status = proc_pool_walk_dir(ws->pool, dir, flags & ACTION_FOLLOWLINKS,
+				walk_job_entry, ws->workerExit, &job);
+	} else
+#endif
 	while ((next = readdir(dir)) != NULL) {
-		char *nextFile;
 		int s;
 
-		nextFile = concat_subpath_file(fileName, next->d_name);
-		if (nextFile == NULL)
+		if (DOT_OR_DOTDOT(next->d_name))
 			continue;
 
 		/* process every file (NB: ACTION_RECURSE is set in flags) */
-		s = recursive_action(nextFile, flags, fileAction, dirAction,
-						userData, depth + 1);
+		s = walk_child(ws,
+#if WALK_AT
+				dirfd(dir), next->d_name, next->d_type,
+#else
+				-1, next->d_name, DT_UNKNOWN,
+#endif
+				pathlen, depth + 1);
 		if (s == FALSE)
 			status = FALSE;
-		free(nextFile);
 //#define RECURSE_RESULT_ABORT -1
 //		if (s == RECURSE_RESULT_ABORT) {
 //			closedir(dir);
@@ -152,9 +274,10 @@ int FAST_FUNC recursive_action(const char *fileName,
 //		}
 	}
 	closedir(dir);
+	ws->path[pathlen] = '\0';
 
 	if (flags & ACTION_DEPTHFIRST) {
-		if (!dirAction(fileName, &statbuf, userData, depth))
+		if (!ws->dirAction(ws->path, &statbuf, ws->userData, depth))
 			goto done_nak_warn;
 	}
 
@@ -162,6 +285,64 @@ int FAST_FUNC recursive_action(const char *fileName,
 
  done_nak_warn:
 	if (!(flags & ACTION_QUIET))
-		bb_simple_perror_msg(fileName);
+		bb_simple_perror_msg(ws->path);
 	return FALSE;
 }
+
+static int walk_top(struct walk_state *ws, const char *fileName, unsigned depth)
+{
+	unsigned len;
+	int status;
+
+	len = strlen(fileName);
+	ws->path_size = len + 256;
+	ws->path = xmalloc(ws->path_size);
+	memcpy(ws->path, fileName, len + 1);
+
+	status = walk(ws, AT_FDCWD, fileName, len, DT_UNKNOWN, depth);
+
+	free(ws->path);
+	return status;
+}
+
+int FAST_FUNC recursive_action(const char *fileName,
+		unsigned flags,
+		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		void* userData,
+		unsigned depth)
+{
+	struct walk_state ws;
+
+	ws.fileAction = fileAction ? fileAction : true_action;
+	ws.dirAction = dirAction ? dirAction : true_action;
+	ws.userData = userData;
+	ws.flags = flags;
+#if ENABLE_FEATURE_PROC_POOL
+	ws.pool = NULL;
+#endif
+	return walk_top(&ws, fileName, depth);
+}
+
+#if ENABLE_FEATURE_PROC_POOL
+int FAST_FUNC recursive_action_parallel(const char *fileName,
+		unsigned flags,
+		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		void* userData,
+		unsigned depth,
+		proc_pool_t *pool,
+		int FAST_FUNC (*workerExit)(int exitcode))
+{
+	struct walk_state ws;
+
+	ws.fileAction = fileAction ? fileAction : true_action;
+	ws.dirAction = dirAction ? dirAction : true_action;
+	ws.userData = userData;
+	ws.flags = flags;
+	ws.pool = pool;
+	ws.workerExit = workerExit;
+	ws.pool_depth = depth;
+	return walk_top(&ws, fileName, depth);
+}
+#endif
@@ -12,7 +12,9 @@
 
 char* FAST_FUNC regcomp_or_errmsg(regex_t *preg, const char *regex, int cflags)
 {
-	int ret = regcomp(preg, regex, cflags);
+	/* REG_DFA makes regexec() reject non-matching strings in one
+	 * pass instead of retrying the match at every offset */
+	int ret = regcomp(preg, regex, cflags | REG_DFA);
 	if (ret) {
 		int errmsgsz = regerror(ret, preg, NULL, 0);
 		char *errmsg = xmalloc(errmsgsz);
@@ -0,0 +1,198 @@
+/* vi: set sw=4 ts=4: */
+/*
+ * Time the bundled regex engine (win32/regex.c) with and without
+ * REG_DFA, the way grep uses it: one regexec() per line.
+ *
+ * Build on any host:
+ *	gcc -O2 -I win32 -o regex_bench scripts/regex_bench.c win32/regex.c
+ * Run:
+ *	./regex_bench [-i] [-m NMATCH] [-r RUNS] [-f FILE] PATTERN...
+ *
+ * Without -f, the input is 2000 pseudo-random lines of 2000 chars
+ * from [a-z ], the same every time. Patterns are EREs. For each one
+ * the best time of RUNS (default 3) passes over the input is shown,
+ * in ms, and the number of matching lines. Exit code is 1 if the two
+ * modes disagree on any line.
+ *
+ * Licensed under GPLv2 or later, see file LICENSE in this source tree.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <regex.h>
+
+static char **lines;
+static unsigned nlines;
+
+static void add_line(char *s)
+{
+	if (!(nlines & 1023)) {
+		lines = realloc(lines, (nlines + 1024) * sizeof(lines[0]));
+		if (!lines) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	lines[nlines++] = s;
+}
+
+static void read_file(const char *fname)
+{
+	FILE *fp = fopen(fname, "r");
+	char *buf = NULL;
+	size_t size = 0, len = 0, r;
+	char *s, *e;
+
+	if (!fp) {
+		perror(fname);
+		exit(2);
+	}
+	do {
+		if (size - len < 64 * 1024) {
+			size = size * 2 + 64 * 1024;
+			buf = realloc(buf, size + 1);
+			if (!buf) {
+				perror("realloc");
+				exit(2);
+			}
+		}
+		r = fread(buf + len, 1, size - len, fp);
+		len += r;
+	} while (r != 0);
+	fclose(fp);
+	buf[len] = '\0';
+
+	for (s = buf; s < buf + len; s = e + 1) {
+		e = memchr(s, '\n', buf + len - s);
+		if (!e)
+			e = buf + len;
+		*e = '\0';
+		add_line(s);
+	}
+}
+
+static void make_lines(void)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz      ";
+	unsigned seed = 1;
+	unsigned i, j;
+
+	for (i = 0; i < 2000; i++) {
+		char *s = malloc(2001);
+		if (!s) {
+			perror("malloc");
+			exit(2);
+		}
+		for (j = 0; j < 2000; j++) {
+			seed = seed * 1103515245 + 12345;
+			s[j] = chars[(seed >> 16) % (sizeof(chars) - 1)];
+		}
+		s[j] = '\0';
+		add_line(s);
+	}
+}
+
+static unsigned long long now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Returns best time in us, fills match[] */
+static unsigned long long run(const char *pattern, int cflags,
+		unsigned nmatch, unsigned runs, char *match)
+{
+	regex_t re;
+	regmatch_t pm[10];
+	unsigned long long best = -1ULL;
+	unsigned i;
+	int err;
+
+	err = regcomp(&re, pattern, cflags);
+	if (err) {
+		char msg[256];
+		regerror(err, &re, msg, sizeof(msg));
+		fprintf(stderr, "bad regex '%s': %s\n", pattern, msg);
+		exit(2);
+	}
+	while (runs--) {
+		unsigned long long t = now_us();
+		for (i = 0; i < nlines; i++)
+			match[i] = (regexec(&re, lines[i], nmatch, pm, 0) == 0);
+		t = now_us() - t;
+		if (best > t)
+			best = t;
+	}
+	regfree(&re);
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int cflags = REG_EXTENDED;
+	unsigned nmatch = 0;
+	unsigned runs = 3;
+	char *match_old, *match_dfa;
+	int rc = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "im:r:f:")) != -1) {
+		switch (opt) {
+		case 'i':
+			cflags |= REG_ICASE;
+			break;
+		case 'm':
+			nmatch = atoi(optarg);
+			if (nmatch > 10)
+				nmatch = 10;
+			break;
+		case 'r':
+			runs = atoi(optarg);
+			if (runs == 0)
+				runs = 1;
+			break;
+		case 'f':
+			read_file(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (!argv[optind]) {
+ usage:
+		fprintf(stderr, "Usage: %s [-i] [-m NMATCH] [-r RUNS] [-f FILE] PATTERN...\n", argv[0]);
+		return 2;
+	}
+	if (!lines)
+		make_lines();
+
+	match_old = malloc(nlines);
+	match_dfa = malloc(nlines);
+	if (!match_old || !match_dfa) {
+		perror("malloc");
+		return 2;
+	}
+
+	printf("%-20s %10s %10s %8s\n", "pattern", "old ms", "REG_DFA ms", "matches");
+	for (; argv[optind]; optind++) {
+		const char *pattern = argv[optind];
+		unsigned long long t_old, t_dfa;
+		unsigned i, n;
+
+		t_old = run(pattern, cflags, nmatch, runs, match_old);
+		t_dfa = run(pattern, cflags | REG_DFA, nmatch, runs, match_dfa);
+		n = 0;
+		for (i = 0; i < nlines; i++)
+			n += match_old[i];
+		printf("%-20s %10llu %10llu %8u\n", pattern,
+				t_old / 1000, t_dfa / 1000, n);
+		if (memcmp(match_old, match_dfa, nlines) != 0) {
+			fprintf(stderr, "'%s': REG_DFA results differ\n", pattern);
+			rc = 1;
+		}
+	}
+	return rc;
+}
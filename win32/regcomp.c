@@ -524,9 +524,13 @@ regcomp (regex_t *__restrict preg,
 
   /* We have already checked preg->fastmap != NULL.  */
   if (BE (ret == REG_NOERROR, 1))
-    /* Compute the fastmap now, since regexec cannot modify the pattern
-       buffer.  This function never fails in this implementation.  */
-    (void) re_compile_fastmap (preg);
+    {
+      /* Compute the fastmap now, since regexec cannot modify the pattern
+	 buffer.  This function never fails in this implementation.  */
+      (void) re_compile_fastmap (preg);
+      if (cflags & REG_DFA)
+	((re_dfa_t *) preg->buffer)->search_budget = SEARCH_TRTABLE_MAX;
+    }
   else
     {
       /* Some error occurred while compiling the expression.  */
@@ -291,6 +291,12 @@ extern reg_syntax_t re_syntax_options;
    If not set, then returns differ between not matching and errors.  */
 #define REG_NOSUB (REG_NEWLINE << 1)
 
+/* If this bit is set, regexec first scans the string once with a lazily
+     built DFA which tries all starting positions in parallel, and only
+     runs the per-position matcher if that scan found a match.
+   If not set, every possible starting position is tried in turn.  */
+#define REG_DFA (REG_NOSUB << 1)
+
 
 /* POSIX `eflags' bits (i.e., information for regexec).  */
 
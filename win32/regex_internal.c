@@ -1614,6 +1614,7 @@ free_state (re_dfastate_t *state)
   re_node_set_free (&state->nodes);
   re_free (state->word_trtable);
   re_free (state->trtable);
+  re_free (state->search_trtable);
   re_free (state);
 }
 
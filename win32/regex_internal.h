@@ -538,6 +538,8 @@ struct re_dfastate_t
   re_node_set inveclosure;
   re_node_set *entrance_nodes;
   struct re_dfastate_t **trtable, **word_trtable;
+  /* Transitions of the REG_DFA search automaton, see regexec.c.  */
+  struct re_dfastate_t **search_trtable;
   unsigned int context : 4;
   unsigned int halt : 1;
   /* If this state can accept `multi byte'.
@@ -550,6 +552,10 @@ struct re_dfastate_t
 };
 typedef struct re_dfastate_t re_dfastate_t;
 
+/* Upper limit on the number of REG_DFA search transition tables
+   (SBC_MAX pointers each) kept per pattern.  */
+#define SEARCH_TRTABLE_MAX 256
+
 struct re_state_table_entry
 {
   int num;
@@ -689,6 +695,9 @@ struct re_dfa_t
   unsigned int map_notascii : 1;
   unsigned int word_ops_used : 1;
   int mb_cur_max;
+  /* Number of search transition tables which may still be built,
+     0 if REG_DFA is not in use.  */
+  int search_budget;
   bitset_t word_char;
   reg_syntax_t syntax;
   int *subexp_map;
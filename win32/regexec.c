@@ -55,6 +55,8 @@ static unsigned re_copy_regs (struct re_registers *regs, regmatch_t *pmatch,
 static reg_errcode_t prune_impossible_nodes (re_match_context_t *mctx);
 static int check_matching (re_match_context_t *mctx, int fl_longest_match,
 			   int *p_match_first) internal_function;
+static int check_matching_search (re_match_context_t *mctx, int last_start,
+				  const char *fastmap) internal_function;
 static int check_halt_state_context (const re_match_context_t *mctx,
 				     const re_dfastate_t *state, int idx)
      internal_function;
@@ -709,6 +711,36 @@ re_search_internal (const regex_t *preg,
   mctx.input.tip_context = (eflags & REG_NOTBOL) ? CONTEXT_BEGBUF
 			   : CONTEXT_NEWLINE | CONTEXT_BEGBUF;
 
+  /* With REG_DFA, first find out whether there is a match at all,
+     trying all the starting indexes at once.  If the caller only wants
+     to know that, we are done; otherwise look for the leftmost match
+     below, as usual.  Back references, and multibyte characters,
+     can't be handled by the search automaton.  */
+  if (dfa->search_budget > 0 && range > 0 && !dfa->nbackref
+      && dfa->mb_cur_max == 1 && !dfa->has_mb_node)
+    {
+      err = re_string_reconstruct (&mctx.input, match_first, eflags);
+      if (BE (err != REG_NOERROR, 0))
+	goto free_return;
+      match_last = check_matching_search (&mctx, range, fastmap);
+      if (BE (match_last == -2, 0))
+	{
+	  err = REG_ESPACE;
+	  goto free_return;
+	}
+      if (match_last == -1)
+	{
+	  err = REG_NOMATCH;
+	  goto free_return;
+	}
+      if (match_last >= 0 && nmatch == 0)
+	{
+	  err = REG_NOERROR;
+	  goto free_return;
+	}
+      match_last = -1;
+    }
+
   /* Check incrementally whether of not the input string match.  */
   incr = (range < 0) ? -1 : 1;
   left_lim = (range < 0) ? start + range : start;
@@ -1204,6 +1236,202 @@ check_matching (re_match_context_t *mctx, int fl_longest_match,
   return match_last;
 }
 
+/* Free the search transition tables of all the states, so that the
+   cache can be refilled.  The states themselves are kept.  */
+
+static void
+internal_function
+flush_search_trtables (re_dfa_t *dfa)
+{
+  unsigned int i;
+  int j;
+  for (i = 0; i <= dfa->state_hash_mask; ++i)
+    {
+      struct re_state_table_entry *entry = dfa->state_table + i;
+      for (j = 0; j < entry->num; ++j)
+	{
+	  re_free (entry->array[j]->search_trtable);
+	  entry->array[j]->search_trtable = NULL;
+	}
+    }
+  dfa->search_budget = SEARCH_TRTABLE_MAX;
+}
+
+/* Transit the search automaton from STATE by the next input byte.
+   A state of the search automaton is the union of the states of all
+   the matches which may have started at or before the current index,
+   so the result is the usual transition of STATE merged with the
+   initial state for the new index.  Transitions are cached in the
+   state's SEARCH_TRTABLE, at most SEARCH_TRTABLE_MAX tables per
+   pattern; when the budget runs out all the tables are flushed.
+   Return NULL with *ERR == REG_NOERROR if the two states can't be
+   merged (they need different contexts), in which case the caller
+   should fall back to trying every starting index.  */
+
+static re_dfastate_t *
+internal_function
+transit_state_search (reg_errcode_t *err, re_match_context_t *mctx,
+		      re_dfastate_t *state)
+{
+  re_dfa_t *const dfa = (re_dfa_t *) mctx->dfa;
+  re_dfastate_t *next, *init;
+  re_node_set union_nodes;
+  unsigned int context;
+  unsigned char ch = re_string_peek_byte (&mctx->input, 0);
+
+  if (BE (state->search_trtable != NULL, 1)
+      && BE (state->search_trtable[ch] != NULL, 1))
+    {
+      re_string_skip_bytes (&mctx->input, 1);
+      return state->search_trtable[ch];
+    }
+
+  next = transit_state (err, mctx, state);
+  if (BE (next == NULL && *err != REG_NOERROR, 0))
+    return NULL;
+  init = acquire_init_state_context (err, mctx,
+				     re_string_cur_idx (&mctx->input));
+  if (BE (init == NULL, 0))
+    return NULL;
+
+  if (next != NULL && next != init)
+    {
+      if (next->has_constraint && init->has_constraint
+	  && next->context != init->context)
+	return NULL;
+      context = next->has_constraint ? next->context : init->context;
+      *err = re_node_set_init_union (&union_nodes, next->entrance_nodes,
+				     init->entrance_nodes);
+      if (BE (*err != REG_NOERROR, 0))
+	return NULL;
+      next = re_acquire_state_context (err, dfa, &union_nodes, context);
+      re_node_set_free (&union_nodes);
+      if (BE (next == NULL, 0))
+	return NULL;
+    }
+  else
+    next = init;
+
+  if (state->search_trtable == NULL)
+    {
+      if (dfa->search_budget == 1)
+	flush_search_trtables (dfa);
+      state->search_trtable = calloc (sizeof (re_dfastate_t *), SBC_MAX);
+      if (BE (state->search_trtable == NULL, 0))
+	{
+	  *err = REG_ESPACE;
+	  return NULL;
+	}
+      --dfa->search_budget;
+    }
+  state->search_trtable[ch] = next;
+  return next;
+}
+
+/* Check whether any match starts at an index of the buffer up to
+   LAST_START, in a single pass over the input with the search
+   automaton.  Return the index where the first match found ends,
+   -1 if there is no match, -2 in case of an error, or -3 if the
+   search automaton can't be used for this input.
+   While no match is in progress, bytes not in FASTMAP (if not NULL)
+   are skipped without running the automaton.
+   Like check_matching, we assume that the matching starts from the
+   current index of the buffer.  */
+
+static int
+internal_function
+check_matching_search (re_match_context_t *mctx, int last_start,
+		       const char *fastmap)
+{
+  reg_errcode_t err = REG_NOERROR;
+  int cur_str_idx = re_string_cur_idx (&mctx->input);
+  re_dfastate_t *cur_state, *init_state;
+
+  cur_state = acquire_init_state_context (&err, mctx, cur_str_idx);
+  if (BE (cur_state == NULL, 0))
+    return -2;
+
+  for (;;)
+    {
+      int next_char_idx;
+
+      if (fastmap != NULL)
+	{
+	  int idx = re_string_cur_idx (&mctx->input);
+	  init_state = acquire_init_state_context (&err, mctx, idx);
+	  if (BE (init_state == NULL, 0))
+	    return -2;
+	  if (cur_state == init_state)
+	    {
+	      /* Like the fastmap loops in re_search_internal, look at
+		 the raw string, the buffer may not be built that far.  */
+	      const unsigned char *raw = (mctx->input.raw_mbs
+					  + mctx->input.raw_mbs_idx);
+	      RE_TRANSLATE_TYPE t = mctx->input.trans;
+	      int lim = (last_start < mctx->input.stop
+			 ? last_start + 1 : mctx->input.stop);
+	      while (idx < lim && !fastmap[t ? t[raw[idx]] : raw[idx]])
+		++idx;
+	      /* As there, fastmap[0] tells whether to try at the end.  */
+	      if (idx >= lim
+		  && (idx > last_start || !fastmap[t ? t[0] : 0]))
+		return -1;
+	      if (idx != re_string_cur_idx (&mctx->input))
+		{
+		  if (idx < mctx->input.valid_len)
+		    re_string_set_index (&mctx->input, idx);
+		  else
+		    {
+		      err = re_string_reconstruct (&mctx->input,
+						   mctx->input.raw_mbs_idx + idx,
+						   mctx->eflags);
+		      if (BE (err != REG_NOERROR, 0))
+			return -2;
+		      last_start -= idx;
+		      idx = 0;
+		    }
+		  cur_state = acquire_init_state_context (&err, mctx, idx);
+		  if (BE (cur_state == NULL, 0))
+		    return -2;
+		}
+	    }
+	}
+
+      if (cur_state->halt
+	  && (!cur_state->has_constraint
+	      || check_halt_state_context (mctx, cur_state,
+					   re_string_cur_idx (&mctx->input))))
+	return re_string_cur_idx (&mctx->input);
+
+      if (re_string_eoi (&mctx->input))
+	return -1;
+
+      next_char_idx = re_string_cur_idx (&mctx->input) + 1;
+      if (BE (next_char_idx >= mctx->input.bufs_len, 0)
+	  || (BE (next_char_idx >= mctx->input.valid_len, 0)
+	      && mctx->input.valid_len < mctx->input.len))
+	{
+	  err = extend_buffers (mctx);
+	  if (BE (err != REG_NOERROR, 0))
+	    return -2;
+	}
+
+      if (next_char_idx <= last_start)
+	{
+	  cur_state = transit_state_search (&err, mctx, cur_state);
+	  if (cur_state == NULL)
+	    return err != REG_NOERROR ? -2 : -3;
+	}
+      else
+	{
+	  /* No more matches may start, follow the ones in progress.  */
+	  cur_state = transit_state (&err, mctx, cur_state);
+	  if (cur_state == NULL)
+	    return err != REG_NOERROR ? -2 : -1;
+	}
+    }
+}
+
 /* Check NODE match the current context.  */
 
 static int